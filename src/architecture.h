@@ -4,18 +4,34 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// ISA spec describing the variant being built, selected at compile time
+// e.g. -DISA_SPEC='"isa/wide.h"', see the Makefile for variant targets
+#ifndef ISA_SPEC
+#define ISA_SPEC "isa/base.h"
+#endif
+#include ISA_SPEC
+
+// Geometry derived from the spec
+// Branch opcodes are 0b1<instruction bits><one status bit per flag>
 #define MAX_OPCODES (256)
-#define MAX_DATA_INS (127)
-#define MAX_BRANCH_INS (15)
-#define MAX_STEPS (8)
-#define MICRO_ADDR_WIDTH (11)
-#define MICRO_DATA_WIDTH (24)
+#define MAX_STEPS (1 << ISA_STEP_BITS)
+#define MICRO_ADDR_WIDTH (8 + ISA_STEP_BITS)
+#define MICRO_DATA_WIDTH (24)               // Fixed by the control word fields below
+#define BRANCH_BIT (1 << 7)
+#define STATUS_BITS (FLAG_COUNT)
+#define STATUS_MASK ((1 << STATUS_BITS) - 1)
+#define MAX_DATA_INS (BRANCH_BIT - 1)
+#define MAX_BRANCH_INS ((1 << (7 - STATUS_BITS)) - 1)
+#define MEM_SIZE (1 << 16)
+#define DEVICE_BASE (0xff00)                // Devices are only mapped from here to the end of memory
+#define MNEMONIC_KEYS (26 * 26 * 26)        // Three lowercase letters
 
 typedef enum {
     ARG_NONE,
     ARG_BYTE,
     ARG_ADDR,
     ARG_PNTR,
+    ARG_COUNT,
 } ARG_TYPE;
 
 typedef struct {
@@ -28,6 +44,7 @@ typedef struct {
 typedef struct {
     Inst* insts;            // Instructions
     uint32_t* microcode;    // Microcode
+    int16_t (*lookup)[ARG_COUNT];   // Opcode by mnemonic key and argument type, or -1
 
     // Metadata
     bool initialized;       // Whether architecture is initialized
@@ -85,11 +102,20 @@ typedef enum {
     ALU_OR      = 11,
 } ALU_FUN;
 
+// Status register bits, in the order the spec lists them
+#define ISA_FLAG_ENUM(name, ...) FLAG_##name,
 typedef enum {
-    FLAG_CARRY = 0,
-    FLAG_ZERO  = 1,
-    FLAG_TBD   = 2,
+    ISA_FLAGS(ISA_FLAG_ENUM, ISA_FLAG_ENUM)
+    FLAG_COUNT,
 } FLAG_TYPE;
+#undef ISA_FLAG_ENUM
+
+// Flags set from the ALU result, as a mask of status register bits
+#define ISA_ALU_FLAG_BIT(name, value) | (1 << FLAG_##name)
+#define ISA_NO_FLAG_BIT(name)
+#define ALU_FLAG_MASK (0 ISA_FLAGS(ISA_ALU_FLAG_BIT, ISA_NO_FLAG_BIT))
+
+_Static_assert(FLAG_COUNT < 7, "ERROR: Too many flags to encode branch instructions");
 
 typedef enum {
     FLAG_CLR = 0,
@@ -107,16 +133,30 @@ typedef enum {
     CTL_RESET_STEP      = 1 << 6,
 } CTL_LINES;
 
+// Decode fields of a microcode word
+#define MICRO_DATA_OE(w) (((w) >> 20) & 0xf)
+#define MICRO_DATA_IE(w) (((w) >> 16) & 0xf)
+#define MICRO_ADDR_OE(w) (((w) >> 14) & 0x3)
+#define MICRO_ADDR_IE(w) (((w) >> 12) & 0x3)
+#define MICRO_ALU_FUN(w) (((w) >> 8) & 0xf)
+#define MICRO_CTL(w)     ((w) & 0xff)
+
 // Public functions
 Arch* generate_architecture(void);
 bool is_mnemonic(char* str, long len);
 bool ins_exists(char* str, ARG_TYPE type);
 uint8_t get_opcode(char* str, ARG_TYPE type);
+Inst* get_inst(uint8_t opcode);
+const char* get_mnemonic(uint8_t opcode);
+uint8_t get_cycles(uint8_t opcode);
+uint16_t get_branch_mask(uint8_t opcode);
 
 // Private functions
 void add_micro(DATA_OE data_oe, DATA_IE data_ie, ADDR_OE addr_oe, ADDR_IE addr_ie, ALU_FUN alu_fun, uint8_t ctl);
 void new_ins(char* mnemonic, ARG_TYPE arg, char* desc);
 void new_branch(char* mnemonic, uint8_t bit, uint8_t set, char* desc);
+void add_lookup(char* mnemonic, ARG_TYPE arg, uint8_t opcode);
+int mnemonic_key(const char* str);
 
 #endif // ARCHITECTURE_H
 
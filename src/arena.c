@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define CHUNK_DATA(c) ((uint8_t*)(c) + ALIGN_UP(sizeof(Chunk)))
+
+Chunk* new_chunk(size_t size) {
+
+    Chunk* c = malloc(ALIGN_UP(sizeof(Chunk)) + size);
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+// Allocate size bytes, uninitialized
+void* arena_alloc(Arena* arena, size_t size) {
+
+    size = ALIGN_UP(size);
+
+    // Add a chunk at least as big as everything so far, so chunk count stays logarithmic
+    Chunk* c = arena->head;
+    if (c == NULL || c->size - c->used < size) {
+        size_t chunk_size = arena->total > DEFAULT_CHUNK_SIZE ? arena->total : DEFAULT_CHUNK_SIZE;
+        if (chunk_size < size) chunk_size = size;
+        c = new_chunk(chunk_size);
+        c->next = arena->head;
+        arena->head = c;
+        arena->total += chunk_size;
+    }
+
+    void* ptr = CHUNK_DATA(c) + c->used;
+    c->used += size;
+    arena->last = ptr;
+    return ptr;
+}
+
+// Resize allocation, in place if it is the most recent one and there is room
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+
+    Chunk* c = arena->head;
+    if (ptr != NULL && ptr == arena->last) {
+        size_t offset = (uint8_t*)ptr - CHUNK_DATA(c);
+        if (offset + ALIGN_UP(new_size) <= c->size) {
+            c->used = offset + ALIGN_UP(new_size);
+            return ptr;
+        }
+    }
+
+    void* grown = arena_alloc(arena, new_size);
+    if (ptr != NULL) memcpy(grown, ptr, old_size);
+    return grown;
+}
+
+void free_chunks(Arena* arena) {
+
+    Chunk* c = arena->head;
+    while (c != NULL) {
+        Chunk* next = c->next;
+        free(c);
+        c = next;
+    }
+    arena->head = NULL;
+    arena->last = NULL;
+}
+
+// Release every allocation
+// Chunks are merged into one the size of all of them, so once that holds the peak
+// a reset is O(1) and later allocations never call malloc
+void reset_arena(Arena* arena) {
+
+    if (arena->head != NULL && arena->head->next != NULL) {
+        free_chunks(arena);
+        arena->head = new_chunk(arena->total);
+    }
+    if (arena->head != NULL) arena->head->used = 0;
+    arena->last = NULL;
+}
+
+void free_arena(Arena* arena) {
+
+    free_chunks(arena);
+    arena->total = 0;
+}
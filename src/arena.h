@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_ALIGN (16)
+#define DEFAULT_CHUNK_SIZE (64 << 10)
+
+// Block of memory allocations are carved from, newest chunk first
+typedef struct Chunk {
+    struct Chunk* next;
+    size_t size;            // Usable bytes after the header
+    size_t used;
+} Chunk;
+
+// Bump allocator, everything in it is released together by reset_arena
+typedef struct {
+    Chunk* head;            // Chunk allocations currently come from
+    size_t total;           // Usable bytes over all chunks
+    void* last;             // Most recent allocation, the only one that can grow in place
+} Arena;
+
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+void reset_arena(Arena* arena);
+void free_arena(Arena* arena);
+
+#endif // ARENA_H
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "architecture.h"
+#include "assembler.h"
+#include "rom.h"
+
+int main(int argc, const char** argv) {
+
+    const char* filename = "example.asm";
+    const char* outname = NULL;
+    const char* mapname = NULL;
+    bool optimize_code = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-O") == 0) {
+            optimize_code = true;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outname = argv[++i];
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            mapname = argv[++i];
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    // Initialize architecture
+    generate_architecture();
+
+    // Tokenize, optimize and assemble
+    if (assemble_file(filename, optimize_code, true) < 0) return 1;
+
+    // Dump code
+    for (uint32_t i = 0; i < a.i; i++) {
+
+        printf("%02x ", a.code[i]);
+        if (i % 16 == 15) printf("\n");
+    }
+    printf("\n");
+
+    // Write program binary for the emulator, with a patch of pages changed since the last build
+    if (outname != NULL && !write_rom(outname, a.code, a.i)) {
+        printf("ERROR: Unable to open %s\n", outname);
+        return 1;
+    }
+
+    // Write debug map for symbolizing addresses
+    if (mapname != NULL && !write_debug_map(mapname)) {
+        printf("ERROR: Unable to open %s\n", mapname);
+        return 1;
+    }
+
+}
@@ -4,52 +4,42 @@
 
 #include "architecture.h"
 #include "tokenizer.h"
+#include "optimizer.h"
+#include "debugmap.h"
+#include "assembler.h"
 
-#define MAX_ADDR_VAL ((1 << 16) - 1)
-#define MAX_BYTE_VAL ((1 << 8)  - 1)
-#define DEFAULT_LABEL_CAPACITY (256)
+// Errors in expanded code also give the line of the .rept or macro call that expanded it
+#define PRINT_ERR(str) (a.errors++, t.origin != 0 \
+    ? printf("ERROR Line %d, expanded from line %d: " str "\n", t.line, t.origin) \
+    : printf("ERROR Line %d: " str "\n", t.line))
 
-#define MIN(x, y) ((x) < (y) ? (x) : (y))
-#define PRINT_ERR(str) (printf("ERROR Line %d: " str "\n", t.line))
+// Thread local, so test runners can assemble on several threads at once
+_Thread_local Assembler a;
 
-typedef struct {
-    const char* str;    // Label string
-    uint16_t len;       // Length of string
-    uint16_t addr;      // Address of label def, or ref
-    uint16_t line;      // Line label was found on (for error reporting)
-} Label;
+// Initialize assembler struct for tokens
+// Tables are sized from the tokens up front, so they never grow during assembly
+void init_assembler(Token* tokens, int count) {
 
-typedef struct {
-    Token* tokens;
-    int count;
-    int curr;
-
-    uint8_t code[MAX_ADDR_VAL + 1];
-    uint16_t i;
-
-    // Label definitions
-    Label* label_defs;
-    int def_count;
-    int def_capacity;
-
-    // Label references
-    Label* label_refs;
-    int ref_count;
-    int ref_capacity;
-} Assembler;
+    a.curr = 0;
+    a.i = 0;
+    a.full = false;
+    a.errors = 0;
 
-Assembler a;
-
-// Initialize assembler struct
-void init_assembler(void) {
+    int labels = 0;
+    for (int i = 0; i < count; i++) labels += tokens[i].type == TOKEN_LABEL;
 
     a.def_count = 0;
-    a.def_capacity = DEFAULT_LABEL_CAPACITY;
-    a.label_defs = calloc(a.def_capacity, sizeof(Label));
+    a.label_defs = arena_alloc(&a.arena, labels * sizeof(Label));
 
     a.ref_count = 0;
-    a.ref_capacity = DEFAULT_LABEL_CAPACITY;
-    a.label_refs = calloc(a.def_capacity, sizeof(Label));
+    a.label_refs = arena_alloc(&a.arena, labels * sizeof(Label));
+
+    a.debug_count = 0;
+    a.debug = arena_alloc(&a.arena, count * sizeof(DebugEntry));
+}
+
+void free_assembler(void) {
+    free_arena(&a.arena);
 }
 
 // Get current token, increment iterator
@@ -71,11 +61,6 @@ Token peek_token(void) {
 // Capture label reference for later filling in
 void capture_ref(Token t) {
 
-    if (a.ref_count == a.ref_capacity) {
-        a.ref_capacity *= 2;
-        a.label_refs = realloc(a.label_refs,a.ref_capacity * sizeof(Label));
-    }
-
     // Capture reference
     a.label_refs[a.ref_count] = (Label){t.str, t.len, a.i, t.line};
     a.ref_count++;
@@ -84,19 +69,41 @@ void capture_ref(Token t) {
 // Define label
 void define_label(Token t) {
 
-    if (a.def_count == a.def_capacity) {
-        a.def_capacity *= 2;
-        a.label_defs = realloc(a.label_defs,a.def_capacity * sizeof(Label));
-    }
-
     // Capture definition
     a.label_defs[a.def_count] = (Label){t.str, t.len, a.i, t.line};
     a.def_count++;
 
 }
 
-// Write byte to compiled code
+// Record that code from the current address on comes from token's line
+void mark_line(Token t) {
+
+    uint16_t label = a.def_count > 0 ? a.def_count - 1 : DEBUG_NO_LABEL;
+
+    if (a.debug_count > 0) {
+        DebugEntry prev = a.debug[a.debug_count - 1];
+        // Previous entry covered no code, overwrite it
+        if (prev.addr == a.i) {
+            a.debug_count--;
+        // Still on the same line, extend previous entry
+        } else if (prev.line == t.line && prev.label == label) {
+            return;
+        }
+    }
+
+    a.debug[a.debug_count] = (DebugEntry){a.i, label, t.line};
+    a.debug_count++;
+}
+
+// Write byte to compiled code, bytes past the end of memory are reported once and dropped
 void write_byte(uint8_t byte) {
+
+    if (a.i == MEM_SIZE) {
+        Token t = a.tokens[a.curr - 1];
+        if (!a.full) PRINT_ERR("Program larger than 16bit address space");
+        a.full = true;
+        return;
+    }
     a.code[a.i++] = byte;
 }
 
@@ -154,12 +161,34 @@ void parse_mnemonic(void) {
     }
 }
 
+// Lookup label definition, place address in addr pointer if it exists
+bool lookup_label_def(Label ref, uint16_t* addr) {
+
+    for (uint16_t i = 0; i < a.def_count; i++) {
+        Label def = a.label_defs[i];
+        if (ref.len == def.len && strncmp(ref.str, def.str, def.len) == 0) {
+            *addr = def.addr;
+            return true;
+        }
+    }
+    return false;
+}
+
 void parse_label(void) {
 
     Token t = get_token();
     Token n = get_token();
     if (n.type != TOKEN_COLON) {
         PRINT_ERR("Expected label definition");
+        return;
+    }
+
+    // Only the first definition would ever be used, whether or not either came from an expansion
+    uint16_t addr;
+    if (lookup_label_def((Label){t.str, t.len, a.i, t.line}, &addr)) {
+        if (t.origin != 0) PRINT_ERR("Label defined again by .rept or macro expansion");
+        else PRINT_ERR("Label defined again");
+        return;
     }
     define_label(t);
 }
@@ -180,19 +209,6 @@ void parse_string(void) {
     write_byte(0);  // Null-terminate the string
 }
 
-// Lookup label definition, place address in addr pointer if it exists
-bool lookup_label_def(Label ref, uint16_t* addr) {
-
-    for (uint16_t i = 0; i < a.def_count; i++) {
-        Label def = a.label_defs[i];
-        if (strncmp(ref.str, def.str, MIN(ref.len, def.len)) == 0) {
-            *addr = def.addr;
-            return true;
-        }
-    }
-    return false;
-}
-
 void resolve_labels(void) {
 
     uint16_t def_addr;
@@ -216,6 +232,7 @@ void assemble(Token* tokens, int count) {
     // TODO: Only allow random bytes and strings in a data section of file
     Token t = peek_token();
     while (t.type != TOKEN_END) {
+        if (t.type != TOKEN_LABEL) mark_line(t);
         switch (t.type) {
         case TOKEN_MNEMONIC:
             parse_mnemonic();
@@ -231,6 +248,7 @@ void assemble(Token* tokens, int count) {
             break;
         default:
             PRINT_ERR("Unexpected token while parsing");
+            a.curr++;
         }
         t = peek_token();
     }
@@ -238,31 +256,48 @@ void assemble(Token* tokens, int count) {
     resolve_labels();
 }
 
-int main(int argc, const char** argv) {
+// Write debug map of address ranges to source lines and labels
+bool write_debug_map(const char* file) {
 
-    const char* filename = "example.asm";
-    if (argc == 2) {
-        filename = argv[1];
-    }
+    FILE* f = fopen(file, "wb");
+    if (f == NULL) return false;
 
-    // Initialize architecture
-    generate_architecture();
+    uint32_t string_size = 0;
+    for (int i = 0; i < a.def_count; i++) string_size += a.label_defs[i].len + 1;
 
-    // Tokenize
-    Token* tokens;
-    int count;
-    count = tokenize(filename, &tokens);
+    DebugMapHeader h = {DEBUG_MAP_MAGIC, a.debug_count, a.def_count, string_size, a.i};
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(a.debug, sizeof(DebugEntry), a.debug_count, f);
+
+    uint32_t offset = 0;
+    for (int i = 0; i < a.def_count; i++) {
+        fwrite(&offset, sizeof(offset), 1, f);
+        offset += a.label_defs[i].len + 1;
+    }
+    for (int i = 0; i < a.def_count; i++) {
+        fwrite(a.label_defs[i].str, 1, a.label_defs[i].len, f);
+        fputc(0, f);
+    }
 
-    if (count == 0) return 1;
+    fclose(f);
+    return true;
+}
 
-    init_assembler();
-    assemble(tokens, count);
+// Tokenize, optionally optimize, and assemble file into a.code
+// Return length of code, or -1 if file couldn't be tokenized, assembly errors are counted in a.errors
+// Everything from the previous file is released first, results stay valid until the next call
+int assemble_file(const char* file, bool optimize_code, bool verbose) {
 
-    // Dump code
-    for (int i = 0; i < a.i; i++) {
+    reset_arena(&a.arena);
 
-        printf("%02x ", a.code[i]);
-        if (i % 16 == 15) printf("\n");
-    }
+    Token* tokens;
+    int count = tokenize(file, &tokens, &a.arena, verbose);
+    if (count == 0) return -1;
+
+    // Peephole optimize before labels are placed
+    if (optimize_code) count = optimize(tokens, count, &a.arena);
 
+    init_assembler(tokens, count);
+    assemble(tokens, count);
+    return a.i;
 }
@@ -0,0 +1,52 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "arena.h"
+#include "tokenizer.h"
+#include "debugmap.h"
+
+#define MAX_ADDR_VAL ((1 << 16) - 1)
+#define MAX_BYTE_VAL ((1 << 8)  - 1)
+
+typedef struct {
+    const char* str;    // Label string
+    uint16_t len;       // Length of string
+    uint16_t addr;      // Address of label def, or ref
+    uint16_t line;      // Line label was found on (for error reporting)
+} Label;
+
+typedef struct {
+    Token* tokens;
+    int count;
+    int curr;
+
+    uint8_t code[MAX_ADDR_VAL + 1];
+    uint32_t i;         // Write position, up to MEM_SIZE for code filling all of memory
+    bool full;          // Code ran past the end of memory, later bytes are dropped
+    int errors;         // Errors reported so far
+
+    // Label definitions and references, each at most one per label token
+    Label* label_defs;
+    int def_count;
+    Label* label_refs;
+    int ref_count;
+
+    // Debug map entries, at most one per token
+    DebugEntry* debug;
+    int debug_count;
+
+    Arena arena;        // Source, tokens, labels and debug entries of the current file
+} Assembler;
+
+extern _Thread_local Assembler a;
+
+void init_assembler(Token* tokens, int count);
+void free_assembler(void);
+void assemble(Token* tokens, int count);
+bool write_debug_map(const char* file);
+int assemble_file(const char* file, bool optimize_code, bool verbose);
+
+#endif // ASSEMBLER_H
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "architecture.h"
+#include "tokenizer.h"
+#include "assembler.h"
+#include "emulator.h"
+
+#define MAX_PATH_LEN (256)
+#define MAX_REPEATS (101)
+#define DEFAULT_REPEATS (5)
+#define BENCH_SEED (0x2545f4914f6cdd1dULL)
+
+// Sizes of generated workloads, kept under 64K of output each
+#define LABEL_COUNT (4000)
+#define STRING_COUNT (2000)
+#define COMMENT_LINES (12000)
+#define UNROLL_COUNT (1500)
+
+typedef struct {
+    const char* name;
+    void (*generate)(FILE* f);
+} Workload;
+
+typedef struct {
+    const char* name;
+    const char* source;     // Guest program, must halt
+} Program;
+
+uint64_t rng = BENCH_SEED;
+
+uint64_t next_random(void) {
+
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+// Instructions with a jump or load through a label, most references go forward
+void generate_labels(FILE* f) {
+
+    const char* ops[] = {"jmp", "csr", "lda *", "ldx *", "sta"};
+    for (int i = 0; i < LABEL_COUNT; i++) {
+        int target = next_random() % LABEL_COUNT;
+        fprintf(f, "label_%d_%x:\n    %s%slabel_%d_%x\n", i, i * 7919, ops[i % 5],
+                i % 5 < 2 || i % 5 == 4 ? " " : "", target, target * 7919);
+    }
+    fprintf(f, "    hlt\n");
+}
+
+// Data blocks of strings and bytes
+void generate_strings(FILE* f) {
+
+    for (int i = 0; i < STRING_COUNT; i++) {
+        int len = 8 + next_random() % 16;
+        fprintf(f, "str_%d:\n    \"", i);
+        for (int j = 0; j < len; j++) fputc('a' + next_random() % 26, f);
+        fprintf(f, "\" %d 0x%02x\n", (int)(next_random() % 256), (int)(next_random() % 256));
+    }
+}
+
+// Short instructions between long comments and blank lines
+void generate_comments(FILE* f) {
+
+    const char* ins[] = {"lda 0x%02x", "ldx %d", "tax", "txa", "add 0x%02x", "nop"};
+    for (int i = 0; i < COMMENT_LINES; i++) {
+        if (i % 4 == 0) fprintf(f, "\n; Section %d, a long comment the tokenizer has to skip over quickly\n", i);
+        fprintf(f, "    ");
+        fprintf(f, ins[i % 6], (int)(next_random() % 256));
+        fprintf(f, "    ; comment on line %d\n", i);
+    }
+    fprintf(f, "    hlt\n");
+}
+
+// Register saves around an unrolled kernel body
+const char* save_regs = "    psa\n    psx\n    psy\n";
+const char* restore_regs = "    ppy\n    ppx\n    ppa\n";
+const char* kernel_body = "    lda *0x2000\n    ccf\n    add 3\n    sta 0x2000\n";
+
+// Unrolled kernel spelled out in full
+void generate_unrolled(FILE* f) {
+
+    for (int i = 0; i < UNROLL_COUNT; i++) fprintf(f, "%s%s%s", save_regs, kernel_body, restore_regs);
+    fprintf(f, "    hlt\n");
+}
+
+// Same kernel with macros and .rept, assembling to the same code
+void generate_rept(FILE* f) {
+
+    fprintf(f, ".macro save\n%s.endm\n.macro restore\n%s.endm\n", save_regs, restore_regs);
+    fprintf(f, ".rept %d\n    save\n%s    restore\n.endr\n    hlt\n", UNROLL_COUNT, kernel_body);
+}
+
+Workload workloads[] = {
+    {"labels", generate_labels},
+    {"strings", generate_strings},
+    {"comments", generate_comments},
+    {"unrolled", generate_unrolled},
+    {"rept", generate_rept},
+};
+
+// Compute bound guest programs, each millions of microsteps
+Program programs[] = {
+    {"nested_loops",
+     "    ldy 0\n"
+     "outer:\n"
+     "    ldx 0\n"
+     "inner:\n"
+     "    txa\n    scf\n    sub 1\n    tax\n"
+     "    bzc inner\n"
+     "    tya\n    scf\n    sub 1\n    tay\n"
+     "    bzc outer\n"
+     "    hlt\n"},
+    {"memory_counter",
+     "; 16 bit counter in memory, incremented until it wraps\n"
+     "loop:\n"
+     "    lda *lo\n    ccf\n    add 1\n    sta lo\n"
+     "    lda *hi\n    add 0\n    sta hi\n"
+     "    lda *lo\n    scf\n    cmp 0\n    bzc loop\n"
+     "    lda *hi\n    scf\n    cmp 0\n    bzc loop\n"
+     "    hlt\n"
+     "lo:\n    0\n"
+     "hi:\n    0\n"},
+    {"stack",
+     "; Fibonacci mod 256, keeping the counters on the stack\n"
+     "    lsp 0xfff0\n"
+     "    ldy 250\n"
+     "outer:\n"
+     "    ldx 200\n"
+     "inner:\n"
+     "    psx\n    psy\n"
+     "    lda *f1\n    tax\n"
+     "    ccf\n    add *f0\n    sta f1\n"
+     "    stx f0\n"
+     "    ppy\n    ppx\n"
+     "    txa\n    scf\n    sub 1\n    tax\n"
+     "    bzc inner\n"
+     "    tya\n    scf\n    sub 1\n    tay\n"
+     "    bzc outer\n"
+     "    hlt\n"
+     "f0:\n    0\n"
+     "f1:\n    1\n"},
+};
+
+double now_seconds(void) {
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int compare_doubles(const void* x, const void* y) {
+
+    double a = *(const double*)x;
+    double b = *(const double*)y;
+    return (a > b) - (a < b);
+}
+
+double median(double* samples, int count) {
+
+    qsort(samples, count, sizeof(double), compare_doubles);
+    return samples[count / 2];
+}
+
+// Tokenize and assemble a generated workload, repeats times each
+void bench_workload(Workload* w, const char* dir, int repeats) {
+
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/bench_%s.asm", dir, w->name);
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        printf("ERROR: Unable to open %s\n", path);
+        return;
+    }
+    w->generate(f);
+    fclose(f);
+
+    double tokenize_time[MAX_REPEATS];
+    double assemble_time[MAX_REPEATS];
+    int tokens = 0;
+    int bytes = 0;
+    for (int r = 0; r < repeats; r++) {
+        Token* t;
+        double start = now_seconds();
+        tokens = tokenize(path, &t, &a.arena, false);
+        tokenize_time[r] = now_seconds() - start;
+        reset_arena(&a.arena);
+
+        start = now_seconds();
+        bytes = assemble_file(path, false, false);
+        assemble_time[r] = now_seconds() - start;
+    }
+
+    printf("%-16s %10d tokens %12.0f tokens/s %10d bytes %12.0f bytes/s\n", w->name,
+           tokens, tokens / median(tokenize_time, repeats),
+           bytes, bytes / median(assemble_time, repeats));
+}
+
+// Run a guest program to halt, repeats times
+void bench_program(Program* p, Arch* arch, const char* dir, int repeats) {
+
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/bench_%s.asm", dir, p->name);
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        printf("ERROR: Unable to open %s\n", path);
+        return;
+    }
+    fputs(p->source, f);
+    fclose(f);
+
+    int len = assemble_file(path, false, false);
+    if (len < 0 || a.errors > 0) {
+        printf("ERROR: Unable to assemble %s\n", p->name);
+        return;
+    }
+    Emulator* reset = new_emulator(arch);
+    memcpy(reset->mem, a.code, len);
+
+    // Count instructions once, stepping by hand so the timed runs stay on the fast path
+    Emulator* e = malloc(sizeof(Emulator));
+    memcpy(e, reset, sizeof(Emulator));
+    uint64_t instructions = 0;
+    while (!e->halted) {
+        step_emulator(e);
+        if (e->step == 0) instructions++;
+    }
+
+    double run_time[MAX_REPEATS];
+    uint64_t cycles = 0;
+    for (int r = 0; r < repeats; r++) {
+        memcpy(e, reset, sizeof(Emulator));
+        double start = now_seconds();
+        cycles = run_emulator(e, UINT64_MAX);
+        run_time[r] = now_seconds() - start;
+    }
+
+    double t = median(run_time, repeats);
+    printf("%-16s %10" PRIu64 " steps  %12.0f steps/s  %10" PRIu64 " ins   %12.0f ins/s\n", p->name,
+           cycles, cycles / t, instructions, instructions / t);
+
+    free(e);
+    free(reset);
+}
+
+int main(int argc, const char** argv) {
+
+    const char* dir = "/tmp";
+    int repeats = DEFAULT_REPEATS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            repeats = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        }
+    }
+    if (repeats < 1) repeats = 1;
+    if (repeats > MAX_REPEATS) repeats = MAX_REPEATS;
+
+    Arch* arch = generate_architecture();
+    printf("Medians of %d runs\n", repeats);
+
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+        rng = BENCH_SEED;   // Same workload every time
+        bench_workload(&workloads[i], dir, repeats);
+    }
+    for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        bench_program(&programs[i], arch, dir, repeats);
+    }
+    free_assembler();
+}
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "architecture.h"
+#include "compact.h"
+#include "rom.h"
+
+#define MAX_PATH_LEN (256)
+#define TOP_PREFIX_COUNT (8)
+#define DISPATCH_BIT (MICRO_DATA_WIDTH)     // Bit of compacted word set when the next node is dispatched
+#define NEXT_SHIFT (DISPATCH_BIT + 1)       // First bit of next address in compacted word
+
+// Step sequence several distinct sequences start with
+typedef struct {
+    int seq;        // First sequence starting with it
+    int len;        // Steps in prefix
+    int shared;     // Sequences starting with it
+} Prefix;
+
+// Return node with given contents, adding it if no identical node exists yet
+uint16_t intern_node(CompactRom* c, uint32_t word, uint16_t next, bool dispatch) {
+
+    for (int i = 0; i < c->count; i++) {
+        MicroNode n = c->nodes[i];
+        if (n.word == word && n.next == next && n.dispatch == dispatch) return i;
+    }
+
+    assert(c->count < MAX_NODES);
+    c->nodes[c->count] = (MicroNode){word, next, dispatch};
+    return c->count++;
+}
+
+// Last step of an opcode's sequence, the step before it wraps to the fetch
+int last_step(const uint32_t* row) {
+
+    for (int step = 1; step < MAX_STEPS; step++) {
+        if (row[step] == 0 || (MICRO_CTL(row[step]) & CTL_RESET_STEP)) return step;
+    }
+    return MAX_STEPS - 1;
+}
+
+// Build compacted layout, sharing every common tail
+// Step 0 of each opcode must be the fetch, or empty to halt
+CompactRom* compact_microcode(const uint32_t* microcode) {
+
+    CompactRom* c = calloc(1, sizeof(CompactRom));
+
+    uint32_t fetch = microcode[0];
+    c->halt = intern_node(c, 0, 0, false);
+    c->fetch = intern_node(c, fetch, 0, true);
+
+    for (int op = 0; op < MAX_OPCODES; op++) {
+        const uint32_t* row = &microcode[op * MAX_STEPS];
+        assert((row[0] == fetch || row[0] == 0) && "ERROR: Step 0 must fetch or halt");
+
+        // Build sequence backwards, so each node knows the node after it
+        int last = last_step(row);
+        uint16_t node;
+        if (row[last] == 0) node = c->halt;
+        else node = intern_node(c, row[last], row[0] == 0 ? c->halt : c->fetch, false);
+
+        for (int step = last - 1; step >= 1; step--) node = intern_node(c, row[step], node, false);
+        c->entry[op] = node;
+    }
+
+    while ((1 << c->next_bits) < c->count) c->next_bits++;
+    return c;
+}
+
+// Rebuild the flat, step counter addressed microcode from the compacted layout
+void expand_microcode(CompactRom* c, uint32_t* microcode) {
+
+    memset(microcode, 0, MAX_OPCODES * MAX_STEPS * sizeof(uint32_t));
+
+    for (int op = 0; op < MAX_OPCODES; op++) {
+        uint32_t* row = &microcode[op * MAX_STEPS];
+        MicroNode n = c->nodes[c->entry[op]];
+        for (int step = 1; step < MAX_STEPS; step++) {
+            row[step] = n.word;
+            if (n.word == 0) break;
+
+            // End of sequence, step 0 is whatever it continues with
+            if ((MICRO_CTL(n.word) & CTL_RESET_STEP) || step == MAX_STEPS - 1) {
+                row[0] = c->nodes[n.next].word;
+                break;
+            }
+            n = c->nodes[n.next];
+        }
+    }
+}
+
+// Return cycles an opcode takes when run from the compacted layout, including fetch
+uint8_t compact_cycles(CompactRom* c, uint8_t opcode) {
+
+    uint8_t cycles = 1;
+    MicroNode n = c->nodes[c->entry[opcode]];
+    for (int step = 1; step < MAX_STEPS; step++) {
+        cycles++;
+        if (n.word == 0 || (MICRO_CTL(n.word) & CTL_RESET_STEP)) break;
+        n = c->nodes[n.next];
+    }
+
+    return cycles;
+}
+
+// Copy words of sequence starting at node into seq, return its length
+int read_sequence(CompactRom* c, uint16_t node, uint32_t* seq) {
+
+    int len = 0;
+    MicroNode n = c->nodes[node];
+    while (len < MAX_STEPS - 1) {
+        seq[len++] = n.word;
+        if (n.word == 0 || (MICRO_CTL(n.word) & CTL_RESET_STEP)) break;
+        n = c->nodes[n.next];
+    }
+    return len;
+}
+
+// Return whether opcode is the first to start its sequence, ignoring unused opcodes
+bool first_sequence(CompactRom* c, int opcode) {
+
+    if (c->entry[opcode] == c->halt) return false;
+    for (int i = 0; i < opcode; i++) {
+        if (c->entry[i] == c->entry[opcode]) return false;
+    }
+    return true;
+}
+
+// Number of sequences starting with the first len words of prefix
+int count_prefix(uint32_t seqs[][MAX_STEPS], int* lens, int count, uint32_t* prefix, int len) {
+
+    int matches = 0;
+    for (int i = 0; i < count; i++) {
+        if (lens[i] >= len && memcmp(seqs[i], prefix, len * sizeof(uint32_t)) == 0) matches++;
+    }
+    return matches;
+}
+
+// Order prefixes by words sharing them would save, most first
+int compare_prefixes(const void* x, const void* y) {
+
+    const Prefix* p = x;
+    const Prefix* q = y;
+    return (q->shared - 1) * q->len - (p->shared - 1) * p->len;
+}
+
+// Report longest step sequences that several distinct sequences start with
+// Tails are already shared, these would need a second dispatch to share
+void report_prefixes(CompactRom* c, FILE* f) {
+
+    // Distinct sequences after the fetch, and one opcode using each
+    uint32_t seqs[MAX_OPCODES][MAX_STEPS];
+    int lens[MAX_OPCODES];
+    uint8_t example[MAX_OPCODES];
+    int count = 0;
+    for (int op = 0; op < MAX_OPCODES; op++) {
+        if (!first_sequence(c, op)) continue;
+        lens[count] = read_sequence(c, c->entry[op], seqs[count]);
+        example[count++] = op;
+    }
+
+    // Keep prefixes that can't be extended without losing a sequence
+    Prefix* prefixes = malloc(MAX_OPCODES * MAX_STEPS * sizeof(Prefix));
+    int prefix_count = 0;
+    for (int i = 0; i < count; i++) {
+        for (int len = 2; len <= lens[i]; len++) {
+            int shared = count_prefix(seqs, lens, count, seqs[i], len);
+            if (shared < 2) break;
+            if (len < lens[i] && count_prefix(seqs, lens, count, seqs[i], len + 1) == shared) continue;
+
+            // Report each prefix once, for the first sequence having it
+            if (count_prefix(seqs, lens, i, seqs[i], len) > 0) continue;
+            prefixes[prefix_count++] = (Prefix){i, len, shared};
+        }
+    }
+
+    fprintf(f, "\nShared prefixes, words saved by a second dispatch:\n");
+    qsort(prefixes, prefix_count, sizeof(Prefix), compare_prefixes);
+    for (int i = 0; i < TOP_PREFIX_COUNT && i < prefix_count; i++) {
+        Prefix p = prefixes[i];
+        fprintf(f, "%4d  %d steps in %2d sequences, e.g. %02x %s:", (p.shared - 1) * p.len,
+                p.len, p.shared, example[p.seq], get_mnemonic(example[p.seq]));
+        for (int j = 0; j < p.len; j++) fprintf(f, " %06x", seqs[p.seq][j]);
+        fprintf(f, "\n");
+    }
+    free(prefixes);
+}
+
+// Write size statistics, and check the compacted layout runs every opcode identically
+void compact_report(CompactRom* c, Arch* arch, FILE* f) {
+
+    const uint32_t* microcode = arch->microcode;
+    int flat_words = 1 << MICRO_ADDR_WIDTH;
+    int used = 0;
+    for (int i = 0; i < MAX_OPCODES * MAX_STEPS; i++) used += microcode[i] != 0;
+
+    int sequences = 0;
+    int sequence_words = 0;
+    for (int op = 0; op < MAX_OPCODES; op++) {
+        if (!first_sequence(c, op)) continue;
+        uint32_t seq[MAX_STEPS];
+        sequences++;
+        sequence_words += read_sequence(c, c->entry[op], seq);
+    }
+
+    fprintf(f, "Flat microcode:      %5d words x %d bits, %d non-empty\n", flat_words, MICRO_DATA_WIDTH, used);
+    fprintf(f, "Compacted microcode: %5d words x %d bits, next address %d bits\n",
+            c->count, NEXT_SHIFT + c->next_bits, c->next_bits);
+    fprintf(f, "Entry ROM:           %5d words x %d bits\n", MAX_OPCODES, c->next_bits);
+    fprintf(f, "Distinct sequences:  %5d, %d words before sharing tails\n", sequences, sequence_words);
+
+    // Room left in the flat microcode's address space, at the average sequence length
+    // Sequences need an opcode too, and each branch takes a block of opcodes for its status bits
+    int free_words = flat_words - c->count;
+    int average = sequences > 0 ? (sequence_words + sequences - 1) / sequences : 1;
+    int free_data = MAX_DATA_INS - arch->data_count;
+    int free_branch = MAX_BRANCH_INS - arch->branch_count;
+    int more = free_words / average;
+    if (more > free_data + free_branch) more = free_data + free_branch;
+    fprintf(f, "Free opcodes:        %5d data, %d branch instructions\n", free_data, free_branch);
+    fprintf(f, "Free words:          %5d, about %d more sequences of %d words\n", free_words, more, average);
+
+    // Timing, both per opcode and for the full flat image
+    int same = 0;
+    for (int op = 0; op < MAX_OPCODES; op++) {
+        if (c->entry[op] == c->halt) {
+            same++;
+            continue;
+        }
+        if (compact_cycles(c, op) == get_cycles(op)) same++;
+        else fprintf(f, "ERROR: %02x %s takes %d cycles, compacted %d\n", op, get_mnemonic(op),
+                     get_cycles(op), compact_cycles(c, op));
+    }
+    uint32_t* expanded = malloc(MAX_OPCODES * MAX_STEPS * sizeof(uint32_t));
+    expand_microcode(c, expanded);
+    bool identical = memcmp(expanded, microcode, MAX_OPCODES * MAX_STEPS * sizeof(uint32_t)) == 0;
+    free(expanded);
+    fprintf(f, "Timing:              %d of %d opcodes unchanged, expands to %s microcode\n",
+            same, MAX_OPCODES, identical ? "identical" : "DIFFERENT");
+
+    report_prefixes(c, f);
+}
+
+// Split words of bits width into one image per 8 bit chip, chip 0 holds the high byte
+bool write_chips(const char* dir, const char* name, const uint64_t* words, int count, int bits) {
+
+    int chips = (bits + 7) / 8;
+    uint8_t* image = malloc(count);
+    bool written = true;
+    for (int c = 0; c < chips; c++) {
+        for (int i = 0; i < count; i++) image[i] = words[i] >> (8 * (chips - 1 - c));
+
+        char path[MAX_PATH_LEN];
+        snprintf(path, sizeof(path), "%s/%s_%d.bin", dir, name, c);
+        written = write_rom(path, image, count) && written;
+    }
+    free(image);
+    return written;
+}
+
+// Write compacted microcode and entry ROM images, padded to a power of two
+bool write_compact_rom(CompactRom* c, const char* dir) {
+
+    int size = 1 << c->next_bits;
+    uint64_t* words = calloc(size > MAX_OPCODES ? size : MAX_OPCODES, sizeof(uint64_t));
+    for (int i = 0; i < c->count; i++) {
+        MicroNode n = c->nodes[i];
+        words[i] = n.word | (uint64_t)n.dispatch << DISPATCH_BIT | (uint64_t)n.next << NEXT_SHIFT;
+    }
+    bool written = write_chips(dir, "compact", words, size, NEXT_SHIFT + c->next_bits);
+
+    for (int i = 0; i < MAX_OPCODES; i++) words[i] = c->entry[i];
+    written = write_chips(dir, "entry", words, MAX_OPCODES, c->next_bits) && written;
+
+    free(words);
+    return written;
+}
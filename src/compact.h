@@ -0,0 +1,36 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "architecture.h"
+
+#define MAX_NODES (MAX_OPCODES * MAX_STEPS)
+
+// Compacted microcode replaces the step counter with a next address in every word
+// Identical tails of different opcodes are stored once, and the fetch dispatches
+// through an entry ROM indexed by the opcode, with status bits for branches
+typedef struct {
+    uint32_t word;          // Control word
+    uint16_t next;          // Node executed after this one
+    bool dispatch;          // Next node comes from the entry ROM for the opcode in I instead
+} MicroNode;
+
+typedef struct {
+    MicroNode nodes[MAX_NODES];
+    int count;
+    uint16_t entry[MAX_OPCODES];    // Node for step 1 of each opcode
+    uint16_t fetch;                 // Node every instruction ends on
+    uint16_t halt;                  // Empty word that halts the processor
+    int next_bits;                  // Width of next address and entry fields
+} CompactRom;
+
+CompactRom* compact_microcode(const uint32_t* microcode);
+void expand_microcode(CompactRom* c, uint32_t* microcode);
+uint8_t compact_cycles(CompactRom* c, uint8_t opcode);
+void compact_report(CompactRom* c, Arch* arch, FILE* f);
+bool write_compact_rom(CompactRom* c, const char* dir);
+
+#endif // COMPACT_H
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "emulator.h"
+#include "debugger.h"
+
+#define MAX_LINE_LEN (256)
+#define DEFAULT_DUMP_LEN (16)
+
+// Clear last watch hit, stepping over an exec breakpoint the emulator is stopped on
+void clear_hit(Emulator* e) {
+
+    e->watch->resume = e->watch->hit == WATCH_EXEC;
+    e->watch->hit = WATCH_NONE;
+    e->stop = false;
+}
+
+// Run forward until the next instruction boundary, or a watch is hit
+void step_instruction(Debugger* d) {
+
+    Emulator* e = d->e;
+    clear_hit(e);
+    do {
+        step_emulator(e);
+    } while (e->step != 0 && !e->halted && !e->stop);
+}
+
+// Run forward until a watch is hit, or processor halts
+void run_forward(Debugger* d) {
+
+    clear_hit(d->e);
+    run_emulator(d->e, UINT64_MAX);
+}
+
+// Newest snapshot at or before cycle, return whether one is held
+bool find_snapshot(History* h, uint64_t cycle, uint64_t* n) {
+
+    for (uint64_t i = h->snapshot_head; i > h->snapshot_tail; i--) {
+        if (h->snapshots[(i - 1) % h->snapshot_size].cycles <= cycle) {
+            *n = i - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Move emulator to exactly cycle, going back through history if needed
+bool run_to_cycle(Debugger* d, uint64_t cycle) {
+
+    Emulator* e = d->e;
+    if (cycle < e->cycles) {
+        uint64_t n;
+        if (!find_snapshot(e->history, cycle, &n)) return false;
+        restore_snapshot(e, n);
+    }
+
+    // Watches don't apply when moving to an exact cycle
+    Watch* watch = e->watch;
+    e->watch = NULL;
+    while (e->cycles < cycle && !e->halted) step_emulator(e);
+    e->watch = watch;
+    e->stop = false;
+    watch->hit = WATCH_NONE;
+
+    return e->cycles == cycle;
+}
+
+// Replay from the current state up to end, return whether a stopping point was found
+// With watches, stop at hits, otherwise at instruction boundaries, keeping the last one
+bool replay_to(Debugger* d, uint64_t end, bool watches, uint64_t* found) {
+
+    Emulator* e = d->e;
+    bool hit = false;
+
+    if (!watches) {
+        Watch* watch = e->watch;
+        e->watch = NULL;
+        while (e->cycles < end && !e->halted) {
+            if (e->step == 0) {
+                hit = true;
+                *found = e->cycles;
+            }
+            step_emulator(e);
+        }
+        e->watch = watch;
+        return hit;
+    }
+
+    e->watch->resume = false;
+    while (e->cycles < end && !e->halted) {
+        run_emulator(e, end - e->cycles);
+        if (e->stop && e->cycles < end) {
+            hit = true;
+            *found = e->cycles;
+        }
+        clear_hit(e);
+    }
+    return hit;
+}
+
+// Find the last stopping point before limit
+// Replays one snapshot interval at a time, newest first
+bool search_back(Debugger* d, uint64_t limit, bool watches, uint64_t* found) {
+
+    Emulator* e = d->e;
+    History* h = e->history;
+    uint64_t end = limit;
+
+    for (uint64_t n = h->snapshot_head; n > h->snapshot_tail; n--) {
+        uint64_t start = h->snapshots[(n - 1) % h->snapshot_size].cycles;
+        if (start >= end) continue;
+
+        restore_snapshot(e, n - 1);
+        if (replay_to(d, end, watches, found)) return true;
+        end = start;
+    }
+    return false;
+}
+
+// Print registers, and source location if known
+void print_location(Debugger* d) {
+
+    print_state(d->e);
+    if (d->map == NULL) return;
+
+    DebugEntry* entry = lookup_debug_entry(d->map, d->e->pc);
+    if (entry != NULL) printf("At %s, line %u\n", debug_label_name(d->map, entry->label), entry->line);
+}
+
+// Print which watch stopped the emulator, if any
+void print_hit(Debugger* d) {
+
+    const char* names[WATCH_TYPES] = {"", "Breakpoint", "Read watchpoint", "Write watchpoint"};
+    Watch* w = d->e->watch;
+    if (w->hit != WATCH_NONE) printf("%s hit at %04x\n", names[w->hit], w->hit_addr);
+}
+
+// Report what stopped the emulator at cycle found by a reverse search
+void report_hit(Debugger* d, uint64_t cycle) {
+
+    Emulator* e = d->e;
+    Watch* w = e->watch;
+
+    // Exec breakpoints stop before the fetch without executing, watchpoints after the access
+    w->resume = false;
+    step_emulator(e);
+    if (w->hit != WATCH_EXEC || e->cycles != cycle) {
+        run_to_cycle(d, cycle - 1);
+        w->resume = false;
+        step_emulator(e);
+    }
+    print_hit(d);
+    w->hit = WATCH_NONE;
+    e->stop = false;
+}
+
+// Go back to the previous instruction boundary, or watch hit
+void run_back(Debugger* d, bool watches) {
+
+    uint64_t now = d->e->cycles;
+    uint64_t found;
+    if (search_back(d, now, watches, &found)) {
+        run_to_cycle(d, found);
+        if (watches) report_hit(d, found);
+        return;
+    }
+
+    // Nothing found, stop at the oldest point still in history
+    History* h = d->e->history;
+    if (h->snapshot_head > h->snapshot_tail) restore_snapshot(d->e, h->snapshot_tail);
+    printf("Reached start of history\n");
+}
+
+// Set or clear watch of type on len addresses from addr
+void set_watch_range(Debugger* d, WATCH_TYPE type, uint16_t addr, uint32_t len, bool on) {
+
+    for (uint32_t i = 0; i < len; i++) set_watch(d->e->watch, type, addr + i, on);
+}
+
+void dump_memory(Debugger* d, uint16_t addr, uint32_t len) {
+
+    for (uint32_t i = 0; i < len; i++) {
+        if (i % 16 == 0) printf("%s%04x:", i ? "\n" : "", (uint16_t)(addr + i));
+        printf(" %02x", d->e->mem[(uint16_t)(addr + i)]);
+    }
+    printf("\n");
+}
+
+// Read commands from in until quit or end of input
+void run_debugger(Emulator* e, DebugMap* map, FILE* in) {
+
+    Debugger d = {e, map};
+
+    char line[MAX_LINE_LEN];
+    while (printf("(dbg) "), fflush(stdout), fgets(line, sizeof(line), in) != NULL) {
+
+        char cmd[MAX_LINE_LEN] = {0};
+        char arg1[MAX_LINE_LEN] = {0};
+        char arg2[MAX_LINE_LEN] = {0};
+        int pos = 0;
+        int args = sscanf(line, "%s %s %n%s", cmd, arg1, &pos, arg2);
+        if (args <= 0) continue;
+        uint32_t len = args >= 3 ? strtoul(arg2, NULL, 0) : 1;
+
+        if (strcmp(cmd, "s") == 0 || strcmp(cmd, "step") == 0) {
+            step_instruction(&d);
+            print_hit(&d);
+            print_location(&d);
+        } else if (strcmp(cmd, "c") == 0 || strcmp(cmd, "continue") == 0) {
+            run_forward(&d);
+            print_hit(&d);
+            print_location(&d);
+        } else if (strcmp(cmd, "rs") == 0 || strcmp(cmd, "reverse-step") == 0) {
+            run_back(&d, false);
+            print_location(&d);
+        } else if (strcmp(cmd, "rc") == 0 || strcmp(cmd, "reverse-continue") == 0) {
+            run_back(&d, true);
+            print_location(&d);
+        } else if ((strcmp(cmd, "g") == 0 || strcmp(cmd, "run-to") == 0) && args >= 2) {
+            uint64_t cycle = strtoull(arg1, NULL, 0);
+            if (!run_to_cycle(&d, cycle)) printf("Unable to reach cycle %" PRIu64 "\n", cycle);
+            print_location(&d);
+        } else if ((strcmp(cmd, "b") == 0 || strcmp(cmd, "break") == 0) && args >= 2) {
+            // Anything after "if" is compiled to a condition, without it the break is unconditional
+            uint16_t addr = strtoul(arg1, NULL, 0);
+            if (args >= 3 && strcmp(arg2, "if") == 0) {
+                if (!set_condition(e->watch, addr, line + pos + 2)) continue;
+            } else {
+                free(e->watch->conds[addr]);
+                e->watch->conds[addr] = NULL;
+            }
+            set_watch(e->watch, WATCH_EXEC, addr, true);
+        } else if ((strcmp(cmd, "d") == 0 || strcmp(cmd, "delete") == 0) && args >= 2) {
+            set_watch(e->watch, WATCH_EXEC, strtoul(arg1, NULL, 0), false);
+        } else if ((strcmp(cmd, "w") == 0 || strcmp(cmd, "watch") == 0) && args >= 2) {
+            set_watch_range(&d, WATCH_WRITE, strtoul(arg1, NULL, 0), len, true);
+        } else if ((strcmp(cmd, "rw") == 0 || strcmp(cmd, "rwatch") == 0) && args >= 2) {
+            set_watch_range(&d, WATCH_READ, strtoul(arg1, NULL, 0), len, true);
+        } else if ((strcmp(cmd, "uw") == 0 || strcmp(cmd, "unwatch") == 0) && args >= 2) {
+            set_watch_range(&d, WATCH_READ, strtoul(arg1, NULL, 0), len, false);
+            set_watch_range(&d, WATCH_WRITE, strtoul(arg1, NULL, 0), len, false);
+        } else if ((strcmp(cmd, "m") == 0 || strcmp(cmd, "mem") == 0) && args >= 2) {
+            dump_memory(&d, strtoul(arg1, NULL, 0), args >= 3 ? len : DEFAULT_DUMP_LEN);
+        } else if (strcmp(cmd, "r") == 0 || strcmp(cmd, "regs") == 0) {
+            print_location(&d);
+        } else if (strcmp(cmd, "q") == 0 || strcmp(cmd, "quit") == 0) {
+            break;
+        } else {
+            printf("Commands: step, continue, reverse-step, reverse-continue, run-to <cycle>,\n");
+            printf("          break <addr> [if <cond>], delete <addr>, watch <addr> [len],\n");
+            printf("          rwatch <addr> [len], unwatch <addr> [len], mem <addr> [len], regs, quit\n");
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "emulator.h"
+#include "debugmap.h"
+
+typedef struct {
+    Emulator* e;
+    DebugMap* map;          // Debug map for source locations, or NULL
+} Debugger;
+
+void run_debugger(Emulator* e, DebugMap* map, FILE* in);
+
+#endif // DEBUGGER_H
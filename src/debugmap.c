@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "debugmap.h"
+
+// Read debug map written by the assembler, return NULL if invalid
+DebugMap* load_debug_map(const char* file) {
+
+    FILE* f = fopen(file, "rb");
+    if (f == NULL) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    rewind(f);
+
+    DebugMapHeader h;
+    if (len < (long)sizeof(h) || fread(&h, sizeof(h), 1, f) != 1 || h.magic != DEBUG_MAP_MAGIC) {
+        fclose(f);
+        return NULL;
+    }
+
+    // Confirm sections fit in file before trusting the header
+    long size = h.entry_count * sizeof(DebugEntry) + h.label_count * sizeof(uint32_t) + h.string_size;
+    if (size != len - (long)sizeof(h)) {
+        fclose(f);
+        return NULL;
+    }
+
+    DebugMap* map = calloc(1, sizeof(DebugMap));
+    map->data = malloc(size + 1);
+    fread(map->data, 1, size, f);
+    fclose(f);
+
+    map->entries = map->data;
+    map->entry_count = h.entry_count;
+    map->labels = (uint32_t*)(map->entries + h.entry_count);
+    map->label_count = h.label_count;
+    map->strings = (char*)(map->labels + h.label_count);
+    map->strings[h.string_size] = 0;
+    map->code_end = h.code_end;
+
+    // Every label name must start inside the strings
+    for (uint32_t i = 0; i < h.label_count; i++) {
+        if (map->labels[i] >= h.string_size) {
+            free_debug_map(map);
+            return NULL;
+        }
+    }
+
+    return map;
+}
+
+void free_debug_map(DebugMap* map) {
+
+    if (map == NULL) return;
+    free(map->data);
+    free(map);
+}
+
+// Binary search for the entry covering addr, or NULL if addr is outside the code
+DebugEntry* lookup_debug_entry(DebugMap* map, uint16_t addr) {
+
+    if (addr >= map->code_end) return NULL;
+
+    uint32_t lo = 0;
+    uint32_t hi = map->entry_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (map->entries[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo == 0 ? NULL : &map->entries[lo - 1];
+}
+
+// Name of label, or "??" if label is unknown
+const char* debug_label_name(DebugMap* map, uint16_t label) {
+
+    if (label >= map->label_count) return "??";
+    return map->strings + map->labels[label];
+}
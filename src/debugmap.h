@@ -0,0 +1,41 @@
+#ifndef DEBUGMAP_H
+#define DEBUGMAP_H
+
+#include <stdint.h>
+
+#define DEBUG_MAP_MAGIC (0x50414d44)    // "DMAP"
+#define DEBUG_NO_LABEL (0xffff)
+
+// File layout: header, entries sorted by address, label string offsets, strings
+typedef struct {
+    uint32_t magic;
+    uint32_t entry_count;
+    uint32_t label_count;
+    uint32_t string_size;
+    uint32_t code_end;      // Address after the last byte of code
+} DebugMapHeader;
+
+// Code from addr up to the next entry's addr came from one source line
+typedef struct {
+    uint16_t addr;      // First address of range
+    uint16_t label;     // Index of enclosing label, or DEBUG_NO_LABEL
+    uint32_t line;      // Line in source code
+} DebugEntry;
+
+typedef struct {
+    DebugEntry* entries;    // Entries sorted by address
+    uint32_t entry_count;
+    uint32_t* labels;       // Offset of each label name in strings
+    uint32_t label_count;
+    char* strings;          // NUL-terminated label names
+    uint32_t code_end;      // Address after the last byte of code, nothing from here on is mapped
+
+    void* data;             // Backing buffer for all of the above
+} DebugMap;
+
+DebugMap* load_debug_map(const char* file);
+void free_debug_map(DebugMap* map);
+DebugEntry* lookup_debug_entry(DebugMap* map, uint16_t addr);
+const char* debug_label_name(DebugMap* map, uint16_t label);
+
+#endif // DEBUGMAP_H
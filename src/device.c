@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device.h"
+
+Bus* new_bus(void) {
+
+    Bus* bus = calloc(1, sizeof(Bus));
+    bus->next_event = UINT64_MAX;
+    return bus;
+}
+
+// Release device and its state
+void free_device(Device* d) {
+
+    if (d->free != NULL) d->free(d);
+    free(d);
+}
+
+void free_bus(Bus* bus) {
+
+    if (bus == NULL) return;
+    for (int i = 0; i < bus->device_count; i++) free_device(bus->devices[i]);
+    free(bus);
+}
+
+// Map device over its address range, bus takes ownership of it
+// A device that can't be mapped is freed, return whether it was mapped
+bool attach_device(Bus* bus, Device* d) {
+
+    if (bus->device_count == MAX_DEVICES) {
+        printf("ERROR: Too many devices\n");
+        free_device(d);
+        return false;
+    }
+    if (d->size == 0 || d->base + d->size > MEM_SIZE) {
+        printf("ERROR: Device %s doesn't fit in memory\n", d->name);
+        free_device(d);
+        return false;
+    }
+    // The optimizer assumes memory below the window reads back what was written
+    if (d->base < DEVICE_BASE) {
+        printf("ERROR: Device %s is below the device window at %04x\n", d->name, DEVICE_BASE);
+        free_device(d);
+        return false;
+    }
+    for (uint32_t i = 0; i < d->size; i++) {
+        if (bus->owner[d->base + i] != 0) {
+            printf("ERROR: Device %s overlaps %s\n", d->name, bus->devices[bus->owner[d->base + i] - 1]->name);
+            free_device(d);
+            return false;
+        }
+    }
+
+    bus->devices[bus->device_count++] = d;
+    memset(bus->owner + d->base, bus->device_count, d->size);
+    d->bus = bus;
+    return true;
+}
+
+// Queue event for device on cycle
+bool schedule_event(Bus* bus, Device* d, uint64_t cycle, uint32_t tag) {
+
+    if (bus->event_count == MAX_EVENTS) {
+        printf("ERROR: Event queue full\n");
+        return false;
+    }
+
+    // Sift up
+    int i = bus->event_count++;
+    while (i > 0 && bus->events[(i - 1) / 2].cycle > cycle) {
+        bus->events[i] = bus->events[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    bus->events[i] = (Event){cycle, d, tag};
+    bus->next_event = bus->events[0].cycle;
+    return true;
+}
+
+// Move event at i down until neither child is earlier
+void sift_down(Bus* bus, int i) {
+
+    Event ev = bus->events[i];
+    while (2 * i + 1 < bus->event_count) {
+        int child = 2 * i + 1;
+        if (child + 1 < bus->event_count && bus->events[child + 1].cycle < bus->events[child].cycle) child++;
+        if (ev.cycle <= bus->events[child].cycle) break;
+        bus->events[i] = bus->events[child];
+        i = child;
+    }
+    bus->events[i] = ev;
+}
+
+Event pop_event(Bus* bus) {
+
+    Event top = bus->events[0];
+    bus->event_count--;
+    if (bus->event_count > 0) {
+        bus->events[0] = bus->events[bus->event_count];
+        sift_down(bus, 0);
+    }
+
+    bus->next_event = bus->event_count > 0 ? bus->events[0].cycle : UINT64_MAX;
+    return top;
+}
+
+// Drop all pending events of device
+void cancel_events(Bus* bus, Device* d) {
+
+    int count = 0;
+    for (int i = 0; i < bus->event_count; i++) {
+        if (bus->events[i].device != d) bus->events[count++] = bus->events[i];
+    }
+    bus->event_count = count;
+
+    // Rebuild heap bottom up
+    for (int i = count / 2 - 1; i >= 0; i--) sift_down(bus, i);
+    bus->next_event = count > 0 ? bus->events[0].cycle : UINT64_MAX;
+}
+
+// Fire every event due on or before cycle, events may schedule more
+void run_events(Bus* bus, uint64_t cycle) {
+
+    while (bus->next_event <= cycle) {
+        Event ev = pop_event(bus);
+        ev.device->event(ev.device, ev.tag, ev.cycle);
+    }
+}
+
+uint8_t bus_read(Bus* bus, uint16_t addr, uint64_t cycle) {
+
+    Device* d = bus->devices[bus->owner[addr] - 1];
+    return d->read != NULL ? d->read(d, addr - d->base, cycle) : 0;
+}
+
+void bus_write(Bus* bus, uint16_t addr, uint8_t value, uint64_t cycle) {
+
+    Device* d = bus->devices[bus->owner[addr] - 1];
+    if (d->write != NULL) d->write(d, addr - d->base, value, cycle);
+}
@@ -0,0 +1,62 @@
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "architecture.h"
+
+#define MAX_DEVICES (255)   // Owner table holds a device index + 1 per address
+#define MAX_EVENTS (256)
+
+typedef struct Bus Bus;
+typedef struct Device Device;
+
+// Peripheral mapped over an address range, offsets passed to callbacks are from base
+struct Device {
+    const char* name;
+    uint16_t base;
+    uint32_t size;
+    Bus* bus;           // Bus device is attached to, for scheduling events
+
+    uint8_t (*read)(Device* d, uint16_t offset, uint64_t cycle);
+    void (*write)(Device* d, uint16_t offset, uint8_t value, uint64_t cycle);
+    void (*event)(Device* d, uint32_t tag, uint64_t cycle);  // A scheduled event is due
+    void (*free)(Device* d);                                 // Release state, or NULL
+
+    void* state;        // Device specific state
+};
+
+// Callback due on a cycle, tag lets devices tell their events apart
+typedef struct {
+    uint64_t cycle;
+    Device* device;
+    uint32_t tag;
+} Event;
+
+struct Bus {
+    uint8_t owner[MEM_SIZE];        // Index + 1 of device mapped at address, or 0 for memory
+    Device* devices[MAX_DEVICES];
+    int device_count;
+
+    Event events[MAX_EVENTS];       // Min-heap on cycle
+    int event_count;
+    uint64_t next_event;            // Cycle of earliest event, UINT64_MAX if none
+};
+
+Bus* new_bus(void);
+void free_bus(Bus* bus);
+void free_device(Device* d);
+bool attach_device(Bus* bus, Device* d);
+bool schedule_event(Bus* bus, Device* d, uint64_t cycle, uint32_t tag);
+void cancel_events(Bus* bus, Device* d);
+void run_events(Bus* bus, uint64_t cycle);
+uint8_t bus_read(Bus* bus, uint16_t addr, uint64_t cycle);
+void bus_write(Bus* bus, uint16_t addr, uint8_t value, uint64_t cycle);
+
+// Whether address is handled by a device rather than memory
+static inline bool is_mapped(Bus* bus, uint16_t addr) {
+    return bus != NULL && bus->owner[addr] != 0;
+}
+
+#endif // DEVICE_H
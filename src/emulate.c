@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "architecture.h"
+#include "emulator.h"
+#include "debugger.h"
+#include "peripherals.h"
+#include "compact.h"
+
+#define DEFAULT_MAX_CYCLES (1000000000ULL)
+#define MAX_PATH_LEN (256)
+#define MAX_PRECISE_RANGES (16)
+
+#ifdef PROFILE
+// Write flat report and collapsed stacks to <name>.txt and <name>.folded
+void write_profile(Profile* p, DebugMap* map, const char* name) {
+
+    char path[MAX_PATH_LEN];
+
+    snprintf(path, sizeof(path), "%s.txt", name);
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        printf("ERROR: Unable to open %s\n", path);
+        return;
+    }
+    profile_report(p, map, f);
+    fclose(f);
+
+    snprintf(path, sizeof(path), "%s.folded", name);
+    f = fopen(path, "w");
+    if (f == NULL) {
+        printf("ERROR: Unable to open %s\n", path);
+        return;
+    }
+    profile_folded(p, map, f);
+    fclose(f);
+}
+#endif
+
+int main(int argc, const char** argv) {
+
+    const char* filename = "outputs/program.bin";
+    const char* profile_name = NULL;
+    const char* mapname = NULL;
+    const char* tracename = NULL;
+    const char* dumpname = NULL;
+    const char* consolename = NULL;
+    uint64_t max_cycles = DEFAULT_MAX_CYCLES;
+    uint64_t history_budget = DEFAULT_HISTORY_BUDGET;
+    bool interactive = false;
+    bool devices = false;
+    bool compacted = false;
+    bool stepping = false;
+    uint32_t precise[MAX_PRECISE_RANGES][2];
+    int precise_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            profile_name = argv[++i];
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            mapname = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            tracename = argv[++i];
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            dumpname = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            max_cycles = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            history_budget = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-i") == 0) {
+            interactive = true;
+        } else if (strcmp(argv[i], "-S") == 0) {
+            stepping = true;
+        } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+            // Address range start:end, or a single address
+            char* end;
+            uint32_t first = strtoul(argv[++i], &end, 0);
+            uint32_t last = *end == ':' ? strtoul(end + 1, NULL, 0) : first;
+            if (precise_count == MAX_PRECISE_RANGES || first > last || last >= MEM_SIZE) {
+                printf("ERROR: Invalid precise range %s\n", argv[i]);
+                return 1;
+            }
+            precise[precise_count][0] = first;
+            precise[precise_count][1] = last;
+            precise_count++;
+        } else if (strcmp(argv[i], "-C") == 0) {
+            compacted = true;
+        } else if (strcmp(argv[i], "-D") == 0) {
+            devices = true;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            consolename = argv[++i];
+            devices = true;
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    // Snapshots hold no device state, so reverse execution would replay devices wrongly
+    if (interactive && devices) {
+        printf("ERROR: Devices can't be used with the interactive debugger\n");
+        return 1;
+    }
+
+    // Reverse execution replays steps, which the profile and trace would count twice
+    if (interactive && (profile_name != NULL || tracename != NULL)) {
+        printf("ERROR: Profiling and tracing can't be used with the interactive debugger\n");
+        return 1;
+    }
+
+    Arch* arch = generate_architecture();
+
+    // Debug map from the assembler, for symbolizing addresses
+    DebugMap* map = NULL;
+    if (mapname != NULL) {
+        map = load_debug_map(mapname);
+        if (map == NULL) {
+            printf("ERROR: Unable to read debug map %s\n", mapname);
+            return 1;
+        }
+    }
+
+    // Decode a recorded trace instead of running
+    if (dumpname != NULL) {
+        bool ok = dump_trace(dumpname, map, stdout);
+        if (!ok) printf("ERROR: Unable to read trace %s\n", dumpname);
+        free_debug_map(map);
+        return ok ? 0 : 1;
+    }
+
+    Emulator* e = new_emulator(arch);
+    if (!load_program(e, filename)) {
+        printf("ERROR: Unable to read program %s\n", filename);
+        free_debug_map(map);
+        free(e);
+        return 1;
+    }
+
+    // Microstep flagged ranges, or everything, the rest runs whole instructions at once
+    e->stepping = stepping;
+    for (int i = 0; i < precise_count; i++) set_precise(e, precise[i][0], precise[i][1], true);
+
+    if (profile_name != NULL) {
+#ifdef PROFILE
+        e->profile = new_profile();
+#else
+        printf("ERROR: Profiling not compiled in, rebuild with PROFILE=1\n");
+        free_debug_map(map);
+        free(e);
+        return 1;
+#endif
+    }
+
+    if (tracename != NULL) {
+#ifdef TRACE
+        e->trace = start_trace(tracename);
+        if (e->trace == NULL) {
+            printf("ERROR: Unable to open trace %s\n", tracename);
+            free_debug_map(map);
+            free(e->profile);
+            free(e);
+            return 1;
+        }
+#else
+        printf("ERROR: Tracing not compiled in, rebuild with TRACE=1\n");
+        free_debug_map(map);
+        free(e->profile);
+        free(e);
+        return 1;
+#endif
+    }
+
+    // Run from the compacted layout, sequenced by its next addresses, to check its timing
+    CompactRom* compact = NULL;
+    if (compacted) {
+        compact = compact_microcode(arch->microcode);
+        use_compact(e, compact);
+    }
+
+    // Console and timer mapped at the top of memory, nothing runs if either can't be mapped
+    FILE* console = stdout;
+    bool attached = true;
+    if (devices) {
+        if (consolename != NULL) console = fopen(consolename, "w");
+        if (console == NULL) {
+            printf("ERROR: Unable to open console output %s\n", consolename);
+            console = stdout;
+        }
+        e->bus = new_bus();
+        attached = attach_device(e->bus, new_console(CONSOLE_BASE, console))
+            && attach_device(e->bus, new_timer(TIMER_BASE));
+    }
+
+    // Interactive debugging, with history for reverse execution
+    if (!attached) {
+        printf("ERROR: Unable to map devices\n");
+    } else if (interactive) {
+        e->history = new_history(history_budget, DEFAULT_SNAPSHOT_INTERVAL);
+        e->watch = new_watch();
+        run_debugger(e, map, stdin);
+        free_history(e->history);
+        free_watch(e->watch);
+    } else {
+        run_emulator(e, max_cycles);
+        print_state(e);
+    }
+
+#ifdef TRACE
+    if (e->trace != NULL) stop_trace(e->trace);
+#endif
+
+#ifdef PROFILE
+    if (e->profile != NULL && attached) write_profile(e->profile, map, profile_name);
+#endif
+
+    if (console != stdout) fclose(console);
+    free_bus(e->bus);
+
+    int status = attached && (interactive || e->halted) ? 0 : 1;
+    free_debug_map(map);
+    free(e->profile);
+    free(e->nodes);
+    free(compact);
+    free(e);
+    return status;
+}
@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "architecture.h"
+#include "emulator.h"
+
+// Update status flags from ALU result, expanded from the spec so the hot loop has no table lookups
+#define SET_ALU_FLAG(name, value) e->s |= (uint8_t)(value) << FLAG_##name;
+#define SKIP_FLAG(name)
+
+// Whether a step does anything besides taking a cycle
+bool has_effect(MicroOp op) {
+    return op.data_oe != OE_NO_DATA || op.data_ie != IE_NO_DATA || op.addr_ie != IE_NO_ADDR
+        || (op.ctl & ~CTL_RESET_STEP) != 0;
+}
+
+// Collect steps of opcode's row after the fetch, up to the step that resets the step counter
+// Rows that halt, load I, or change the status bits they were selected by must be stepped
+void decode_instruction(Emulator* e, int opcode) {
+
+    FastInst* f = &e->fast[opcode];
+    f->exact = true;
+    f->cycles = MAX_STEPS - 1;
+
+    for (int step = 1; step < MAX_STEPS; step++) {
+        MicroOp op = e->micro[opcode * MAX_STEPS + step];
+        bool status = op.data_ie == IE_S || (op.ctl & (CTL_SET_STATUS | CTL_SET_CARRY | CTL_CLR_CARRY));
+        if (op.halt || op.data_ie == IE_I || (opcode >> 7 && status)) {
+            f->exact = false;
+            return;
+        }
+
+        if (has_effect(op)) {
+            f->ops[f->count] = op;
+            f->steps[f->count] = step;
+            f->count++;
+        }
+        if (op.ctl & CTL_RESET_STEP) {
+            f->cycles = step;
+            return;
+        }
+    }
+}
+
+// Split microcode word into its control fields
+MicroOp decode_micro(uint32_t word) {
+
+    // Classify memory access once here, so checking watches costs one bit test per step
+    uint8_t watch = WATCH_NONE;
+    if (MICRO_DATA_OE(word) == OE_RAM && MICRO_DATA_IE(word) == IE_I) watch = WATCH_EXEC;
+    else if (MICRO_DATA_OE(word) == OE_RAM) watch = WATCH_READ;
+    else if (MICRO_DATA_IE(word) == IE_RAM) watch = WATCH_WRITE;
+
+    return (MicroOp){
+        MICRO_DATA_OE(word), MICRO_DATA_IE(word),
+        MICRO_ADDR_OE(word), MICRO_ADDR_IE(word),
+        MICRO_ALU_FUN(word), MICRO_CTL(word),
+        word == 0, watch,
+    };
+}
+
+// Create emulator, decoding the architecture's microcode
+Emulator* new_emulator(Arch* arch) {
+
+    Emulator* e = calloc(1, sizeof(Emulator));
+
+    for (int i = 0; i < MAX_OPCODES * MAX_STEPS; i++) e->micro[i] = decode_micro(arch->microcode[i]);
+
+    for (int op = 0; op < MAX_OPCODES; op++) decode_instruction(e, op);
+
+    return e;
+}
+
+// Run from compacted microcode instead, starting on the fetch
+// Every step then follows the next address, the step counter is only kept for reporting
+void use_compact(Emulator* e, CompactRom* c) {
+
+    e->compact = c;
+    e->nodes = malloc(c->count * sizeof(MicroOp));
+    for (int i = 0; i < c->count; i++) e->nodes[i] = decode_micro(c->nodes[i].word);
+    e->upc = c->fetch;
+}
+
+// Load program binary into memory at address 0
+bool load_program(Emulator* e, const char* file) {
+
+    FILE* f = fopen(file, "rb");
+    if (f == NULL) return false;
+
+    fread(e->mem, 1, MEM_SIZE, f);
+    fclose(f);
+    return true;
+}
+
+// Microcode row for current instruction
+// Branch instructions replace the low opcode bits with the status bits
+uint8_t micro_row(Emulator* e) {
+
+    uint8_t opcode = e->i;
+    if (opcode >> 7) opcode = (opcode & ~STATUS_MASK) | (e->s & STATUS_MASK);
+    return opcode;
+}
+
+// Microcode address for current instruction and step
+uint16_t micro_addr(Emulator* e) {
+    return micro_row(e) * MAX_STEPS + e->step;
+}
+
+// Record hit on a watched address, return whether step must not execute
+// Exec breakpoints stop before the fetch, watchpoints after the access
+bool watch_hit(Emulator* e, WATCH_TYPE type, uint16_t addr) {
+
+    Watch* w = e->watch;
+    if (type == WATCH_EXEC) {
+        // Only the breakpoint stopped on is stepped over
+        if (w->resume && addr == w->hit_addr) {
+            w->resume = false;
+            return false;
+        }
+        if (w->conds[addr] != NULL) {
+            uint16_t regs[REG_COUNT] = {e->a, e->x, e->y, e->s, e->pc, e->sp, e->mr};
+            if (!eval_condition(w->conds[addr], regs, e->mem)) return false;
+        }
+    }
+
+    w->hit = type;
+    w->hit_addr = addr;
+    e->stop = true;
+    return type == WATCH_EXEC;
+}
+
+// Address bus for a step
+uint16_t address_bus(Emulator* e, MicroOp op) {
+
+    switch (op.addr_oe) {
+    case OE_PC: return e->pc;
+    case OE_SP: return e->sp;
+    case OE_MR: return e->mr;
+    }
+    return 0;
+}
+
+// Move data for a step and apply its control lines, shared by stepping and whole instructions
+void execute_micro(Emulator* e, MicroOp op, uint16_t abus) {
+
+    // ALU, with carry in from status register
+    uint16_t alu = 0;
+    uint8_t carry = (e->s >> FLAG_CARRY) & 1;
+    switch (op.alu_fun) {
+    case ALU_ADD: alu = e->a + e->b + carry; break;
+    case ALU_SUB: alu = e->a + (uint8_t)~e->b + carry; break;
+    case ALU_AND: alu = e->a & e->b; break;
+    case ALU_OR:  alu = e->a | e->b; break;
+    default:      alu = e->a; break;
+    }
+
+    // Data bus
+    uint8_t dbus = 0;
+    switch (op.data_oe) {
+    case OE_RAM:   dbus = is_mapped(e->bus, abus) ? bus_read(e->bus, abus, e->cycles) : e->mem[abus]; break;
+    case OE_A:     dbus = e->a; break;
+    case OE_X:     dbus = e->x; break;
+    case OE_Y:     dbus = e->y; break;
+    case OE_S:     dbus = e->s; break;
+    case OE_MR_LO: dbus = e->mr & 0xff; break;
+    case OE_MR_HI: dbus = e->mr >> 8; break;
+    case OE_ALU:   dbus = alu & 0xff; break;
+    }
+
+#ifdef TRACE
+    if (e->trace != NULL) trace_record(e->trace, (TraceRecord){e->pc, abus, e->i, e->step, dbus, e->s});
+#endif
+
+    switch (op.data_ie) {
+    case IE_RAM:
+        if (is_mapped(e->bus, abus)) {
+            bus_write(e->bus, abus, dbus, e->cycles);
+            break;
+        }
+        if (e->history != NULL) record_write(e->history, abus, e->mem[abus]);
+        if (e->dirty != NULL && !e->dirty->marked[abus >> 8]) {
+            e->dirty->marked[abus >> 8] = true;
+            e->dirty->pages[e->dirty->count++] = abus >> 8;
+        }
+        e->mem[abus] = dbus;
+        break;
+    case IE_A:     e->a = dbus; break;
+    case IE_X:     e->x = dbus; break;
+    case IE_Y:     e->y = dbus; break;
+    case IE_S:     e->s = dbus; break;
+    case IE_MR_LO: e->mr = (e->mr & 0xff00) | dbus; break;
+    case IE_MR_HI: e->mr = (e->mr & 0x00ff) | (dbus << 8); break;
+    case IE_B:     e->b = dbus; break;
+    case IE_I:     e->i = dbus; break;
+    }
+
+    switch (op.addr_ie) {
+    case IE_PC: e->pc = abus; break;
+    case IE_SP: e->sp = abus; break;
+    case IE_MR: e->mr = abus; break;
+    }
+
+    // Control lines
+    if (op.ctl & CTL_PC_INC) e->pc++;
+    if (op.ctl & CTL_SP_INC) e->sp++;
+    if (op.ctl & CTL_SP_DEC) e->sp--;
+    if (op.ctl & CTL_SET_STATUS) {
+        e->s &= ~ALU_FLAG_MASK;
+        ISA_FLAGS(SET_ALU_FLAG, SKIP_FLAG)
+    }
+    if (op.ctl & CTL_SET_CARRY) e->s |= 1 << FLAG_CARRY;
+    if (op.ctl & CTL_CLR_CARRY) e->s &= ~(1 << FLAG_CARRY);
+}
+
+// Execute a single microcode step
+void step_emulator(Emulator* e) {
+
+    uint16_t addr = micro_addr(e);
+    MicroOp op = e->compact != NULL ? e->nodes[e->upc] : e->micro[addr];
+
+    if (op.halt) {
+        e->halted = true;
+        return;
+    }
+
+    if (e->history != NULL && e->cycles >= e->history->next_snapshot) save_snapshot(e);
+    if (e->bus != NULL && e->cycles >= e->bus->next_event) run_events(e->bus, e->cycles);
+
+    uint16_t abus = address_bus(e, op);
+
+    if (op.watch != WATCH_NONE && e->watch != NULL && test_watch(e->watch, op.watch, abus)
+        && watch_hit(e, op.watch, abus)) return;
+
+    // Stepping over a breakpoint only lasts until the next fetch
+    if (op.watch == WATCH_EXEC && e->watch != NULL) e->watch->resume = false;
+
+    // AFL style edge coverage, an edge is a pair of consecutive (PC, microcode address)
+    if (e->coverage != NULL) {
+        uint16_t cur = (e->pc * 0x9e37u) ^ addr;
+        e->coverage[(cur ^ e->coverage_prev) & (COVERAGE_SIZE - 1)]++;
+        e->coverage_prev = cur >> 1;
+    }
+
+    execute_micro(e, op, abus);
+
+#ifdef PROFILE
+    if (e->profile != NULL) {
+        e->profile->micro_cycles[addr]++;
+        if (e->step == 0) profile_fetch(e->profile, abus, e->i, e->s, e->cycles);
+    }
+#endif
+
+    // Compacted words carry the next address, the fetch dispatches on the opcode it loaded
+    if (e->compact != NULL) {
+        MicroNode n = e->compact->nodes[e->upc];
+        e->upc = n.dispatch ? e->compact->entry[micro_row(e)] : n.next;
+    }
+
+    e->step = (op.ctl & CTL_RESET_STEP) ? 0 : (e->step + 1) % MAX_STEPS;
+    e->cycles++;
+}
+
+// Run step of a whole instruction, unless it touches a device or watched address
+bool fast_step(Emulator* e, MicroOp op) {
+
+    uint16_t abus = address_bus(e, op);
+    if (op.watch != WATCH_NONE && (is_mapped(e->bus, abus)
+        || (e->watch != NULL && test_watch(e->watch, op.watch, abus)))) return false;
+
+    execute_micro(e, op, abus);
+    return true;
+}
+
+// Run instruction at PC from its fetch to its last step, skipping steps without effect
+// Stops before the first step that must be stepped instead, with state exactly as if it had been
+// Return whether any step ran
+bool run_instruction(Emulator* e) {
+
+    MicroOp fetch = e->micro[micro_addr(e)];
+    if (fetch.halt || !fast_step(e, fetch)) return false;
+    if (e->watch != NULL) e->watch->resume = false;
+
+    // Step to hand over at, rows that can't run at once are stepped right after the fetch
+    FastInst* f = &e->fast[micro_row(e)];
+    uint8_t resume = f->exact ? 0 : 1;
+    for (int i = 0; i < f->count && resume == 0; i++) {
+        if (!fast_step(e, f->ops[i])) resume = f->steps[i];
+    }
+
+    uint8_t cycles = resume != 0 ? resume : 1 + f->cycles;
+    e->step = resume;
+    e->cycles += cycles;
+    e->fast_cycles += cycles;
+    return true;
+}
+
+// Flag addresses from start to end inclusive, so instructions there are always stepped
+void set_precise(Emulator* e, uint16_t start, uint16_t end, bool on) {
+
+    for (uint32_t addr = start; addr <= end; addr++) {
+        if (on) e->precise[addr >> 6] |= 1ULL << (addr & 63);
+        else e->precise[addr >> 6] &= ~(1ULL << (addr & 63));
+    }
+}
+
+// Run until halted, stopped by a watch, or max_cycles have executed
+// Whole instructions run at once unless the instruction at PC is flagged precise, a device event
+// is due, or per step instrumentation or compacted microcode is attached, those are stepped
+// Return cycles executed
+uint64_t run_emulator(Emulator* e, uint64_t max_cycles) {
+
+    uint64_t start = e->cycles;
+    bool fast = !e->stepping && e->profile == NULL && e->trace == NULL && e->history == NULL
+        && e->coverage == NULL && e->compact == NULL;
+
+    while (!e->halted && !e->stop && e->cycles - start < max_cycles) {
+        if (fast && e->step == 0 && max_cycles - (e->cycles - start) >= MAX_STEPS
+            && !((e->precise[e->pc >> 6] >> (e->pc & 63)) & 1)
+            && (e->bus == NULL || e->bus->next_event >= e->cycles + MAX_STEPS)
+            && run_instruction(e)) continue;
+        step_emulator(e);
+    }
+
+#ifdef PROFILE
+    if (e->profile != NULL) profile_flush(e->profile, e->cycles);
+#endif
+
+    return e->cycles - start;
+}
+
+// Save register file to a new snapshot, dropping the oldest if full
+void save_snapshot(Emulator* e) {
+
+    History* h = e->history;
+    if (h->snapshot_head - h->snapshot_tail == h->snapshot_size) h->snapshot_tail++;
+
+    h->snapshots[h->snapshot_head % h->snapshot_size] = (Snapshot){
+        e->a, e->x, e->y, e->s, e->b, e->i,
+        e->pc, e->sp, e->mr,
+        e->step, e->upc, e->halted, e->cycles, e->fast_cycles,
+        h->journal_head,
+    };
+    h->snapshot_head++;
+    h->next_snapshot = e->cycles + h->interval;
+}
+
+// Return to snapshot n, undoing memory writes made since and discarding newer snapshots
+void restore_snapshot(Emulator* e, uint64_t n) {
+
+    History* h = e->history;
+    Snapshot snap = h->snapshots[n % h->snapshot_size];
+
+    while (h->journal_head > snap.journal_pos) {
+        h->journal_head--;
+        JournalEntry j = h->journal[h->journal_head % h->journal_size];
+        e->mem[j.addr] = j.old;
+    }
+
+    e->a = snap.a;
+    e->x = snap.x;
+    e->y = snap.y;
+    e->s = snap.s;
+    e->b = snap.b;
+    e->i = snap.i;
+    e->pc = snap.pc;
+    e->sp = snap.sp;
+    e->mr = snap.mr;
+    e->step = snap.step;
+    e->upc = snap.upc;
+    e->halted = snap.halted;
+    e->cycles = snap.cycles;
+    e->fast_cycles = snap.fast_cycles;
+
+    h->snapshot_head = n + 1;
+    h->next_snapshot = e->cycles + h->interval;
+}
+
+void print_state(Emulator* e) {
+
+    printf("A: %02x  X: %02x  Y: %02x  S: %02x\n", e->a, e->x, e->y, e->s);
+    printf("PC: %04x  SP: %04x  MR: %04x  Step: %d\n", e->pc, e->sp, e->mr, e->step);
+    printf("Cycles: %" PRIu64 "%s\n", e->cycles, e->halted ? " (halted)" : "");
+    if (e->fast_cycles > 0) printf("Run as whole instructions: %" PRIu64 " cycles\n", e->fast_cycles);
+}
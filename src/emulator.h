@@ -0,0 +1,99 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "architecture.h"
+#include "profiler.h"
+#include "trace.h"
+#include "history.h"
+#include "watch.h"
+#include "device.h"
+#include "compact.h"
+
+// Microcode word decoded into its control fields
+typedef struct {
+    uint8_t data_oe;
+    uint8_t data_ie;
+    uint8_t addr_oe;
+    uint8_t addr_ie;
+    uint8_t alu_fun;
+    uint8_t ctl;
+    bool halt;          // Empty words stop the clock
+    uint8_t watch;      // WATCH_TYPE of the memory access this step makes
+} MicroOp;
+
+// Instruction level view of one microcode row, for running whole instructions at once
+// Only steps after the fetch that have an effect are kept, the rest only take cycles
+typedef struct {
+    MicroOp ops[MAX_STEPS];
+    uint8_t steps[MAX_STEPS];   // Step each op is on
+    uint8_t count;              // Ops kept
+    uint8_t cycles;             // Cycles after the fetch, including steps without effect
+    bool exact;                 // Whether it can run at once, otherwise it must be stepped
+} FastInst;
+
+#define PAGE_COUNT (MEM_SIZE >> 8)
+#define COVERAGE_SIZE (1 << 14)     // Entries in coverage map, must be a power of 2
+
+// Pages of memory written since tracking was last cleared
+typedef struct {
+    bool marked[PAGE_COUNT];
+    uint8_t pages[PAGE_COUNT];
+    int count;
+} DirtyPages;
+
+typedef struct {
+    // Registers
+    uint8_t a;          // A register
+    uint8_t x;          // X register
+    uint8_t y;          // Y register
+    uint8_t s;          // Status register
+    uint8_t b;          // ALU B register
+    uint8_t i;          // Instruction register
+    uint16_t pc;        // Program counter
+    uint16_t sp;        // Stack pointer
+    uint16_t mr;        // Memory register
+    uint8_t step;       // Microcode step counter
+
+    uint64_t cycles;    // Clock cycles executed
+    bool halted;        // Whether processor has halted
+    bool stop;          // Whether a breakpoint or watchpoint stopped the run
+
+    MicroOp micro[MAX_OPCODES * MAX_STEPS];  // Decoded microcode
+    FastInst fast[MAX_OPCODES];              // Decoded microcode by instruction, with status bits
+    uint8_t mem[MEM_SIZE];                   // Memory
+
+    Profile* profile;   // Profile counters, or NULL when not profiling
+    Trace* trace;       // Trace recorder, or NULL when not tracing
+    History* history;   // Snapshots and write journal, or NULL when not recording
+    Watch* watch;       // Breakpoints and watchpoints, or NULL when not debugging
+    Bus* bus;           // Memory mapped devices, or NULL when there are none
+    DirtyPages* dirty;  // Pages written, or NULL when not tracking
+    uint8_t* coverage;  // Hit counts of (PC, microcode address) edges, or NULL
+    uint16_t coverage_prev;
+
+    // Hybrid execution, whole instructions run at once except where microsteps are needed
+    bool stepping;                      // Step every microcode step, never running whole instructions
+    uint64_t precise[MEM_SIZE / 64];    // One bit per address, instructions there are always stepped
+    uint64_t fast_cycles;               // Cycles run as whole instructions
+
+    // Compacted microcode, sequenced by a micro-PC instead of the step counter
+    CompactRom* compact;    // Layout to run from, or NULL to run the flat microcode
+    MicroOp* nodes;         // Decoded compacted words
+    uint16_t upc;           // Node to execute next
+} Emulator;
+
+Emulator* new_emulator(Arch* arch);
+void use_compact(Emulator* e, CompactRom* c);
+bool load_program(Emulator* e, const char* file);
+void step_emulator(Emulator* e);
+bool run_instruction(Emulator* e);
+void set_precise(Emulator* e, uint16_t start, uint16_t end, bool on);
+uint64_t run_emulator(Emulator* e, uint64_t max_cycles);
+void print_state(Emulator* e);
+void save_snapshot(Emulator* e);
+void restore_snapshot(Emulator* e, uint64_t n);
+
+#endif // EMULATOR_H
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "architecture.h"
+#include "emulator.h"
+#include "watch.h"
+
+#define MAX_INPUT_LEN (255)
+#define MAX_CRASH_ADDRS (64)
+#define MAX_SAVED (64)              // Crashes and hangs saved to disk, of each kind
+#define MAX_PATH_LEN (256)
+#define DEFAULT_CORPUS_CAPACITY (256)
+#define DEFAULT_BUDGET (100000)     // Cycles before an input counts as a hang
+#define DEFAULT_SETUP_BUDGET (100000000ULL)
+#define DEFAULT_SECONDS (10)
+#define EXEC_BATCH (256)            // Executions a worker counts before publishing them
+#define MAX_HAVOC (4)
+
+typedef struct {
+    uint8_t data[MAX_INPUT_LEN];
+    int len;
+} Input;
+
+typedef struct {
+    // Configuration
+    uint16_t input_addr;        // Input length is written here, data just after
+    int max_len;                // Longest input to generate
+    uint64_t budget;            // Cycles per execution
+    const char* outdir;         // Where crashing and hanging inputs are saved
+    uint16_t crash_addrs[MAX_CRASH_ADDRS];  // Executing any of these is a crash
+    int crash_count;
+
+    // Shared between workers
+    Emulator* base;             // State after setup, read only once workers start
+    pthread_mutex_t lock;       // Guards corpus, virgin and saving
+    Input* corpus;
+    int corpus_count;
+    int corpus_capacity;
+    uint8_t virgin[COVERAGE_SIZE];  // Bucketed hit count bits not seen by any input yet
+    int edges;                  // Coverage map entries seen
+    int saved_crashes;
+    int saved_hangs;
+
+    _Atomic uint64_t execs;
+    _Atomic uint64_t crashes;
+    _Atomic uint64_t hangs;
+    _Atomic bool done;
+} Fuzzer;
+
+Fuzzer fz;
+
+// Hit counts grouped into AFL's buckets, so loop counts only matter by magnitude
+uint8_t bucket[256];
+
+void init_buckets(void) {
+
+    for (int i = 0; i < 256; i++) {
+        if (i == 0) bucket[i] = 0;
+        else if (i == 1) bucket[i] = 1 << 0;
+        else if (i == 2) bucket[i] = 1 << 1;
+        else if (i == 3) bucket[i] = 1 << 2;
+        else if (i < 8) bucket[i] = 1 << 3;
+        else if (i < 16) bucket[i] = 1 << 4;
+        else if (i < 32) bucket[i] = 1 << 5;
+        else if (i < 128) bucket[i] = 1 << 6;
+        else bucket[i] = 1 << 7;
+    }
+}
+
+uint64_t next_random(uint64_t* state) {
+
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+void add_corpus(Input* in) {
+
+    if (fz.corpus_count == fz.corpus_capacity) {
+        fz.corpus_capacity *= 2;
+        fz.corpus = realloc(fz.corpus, fz.corpus_capacity * sizeof(Input));
+    }
+    fz.corpus[fz.corpus_count++] = *in;
+}
+
+// Return whether coverage has bits not in virgin, clearing them from virgin if update is set
+bool new_coverage(uint8_t* virgin, const uint8_t* coverage, bool update) {
+
+    bool found = false;
+    for (int i = 0; i < COVERAGE_SIZE; i += 8) {
+        // Most of the map is untouched, skip it a word at a time
+        uint64_t word;
+        memcpy(&word, coverage + i, sizeof(word));
+        if (word == 0) continue;
+
+        for (int j = i; j < i + 8; j++) {
+            uint8_t bits = bucket[coverage[j]] & virgin[j];
+            if (bits == 0) continue;
+            found = true;
+            if (!update) return true;
+            if (virgin[j] == 0xff) fz.edges++;
+            virgin[j] &= ~bits;
+        }
+    }
+    return found;
+}
+
+// Return emulator to state after setup, copying back only pages that were written
+void reset_emulator(Emulator* e) {
+
+    Emulator* b = fz.base;
+    DirtyPages* d = e->dirty;
+    for (int i = 0; i < d->count; i++) {
+        memcpy(e->mem + (d->pages[i] << 8), b->mem + (d->pages[i] << 8), 1 << 8);
+        d->marked[d->pages[i]] = false;
+    }
+    d->count = 0;
+
+    e->a = b->a;
+    e->x = b->x;
+    e->y = b->y;
+    e->s = b->s;
+    e->b = b->b;
+    e->i = b->i;
+    e->pc = b->pc;
+    e->sp = b->sp;
+    e->mr = b->mr;
+    e->step = b->step;
+    e->cycles = b->cycles;
+    e->halted = false;
+    e->stop = false;
+    e->watch->hit = WATCH_NONE;
+
+    memset(e->coverage, 0, COVERAGE_SIZE);
+    e->coverage_prev = 0;
+}
+
+// Write length byte and input to memory, marking pages dirty so reset undoes it
+void write_input(Emulator* e, Input* in) {
+
+    for (int i = 0; i <= in->len; i++) {
+        uint16_t addr = fz.input_addr + i;
+        e->mem[addr] = i == 0 ? in->len : in->data[i - 1];
+        if (!e->dirty->marked[addr >> 8]) {
+            e->dirty->marked[addr >> 8] = true;
+            e->dirty->pages[e->dirty->count++] = addr >> 8;
+        }
+    }
+}
+
+// Apply a few random mutations, splicing with other from the corpus
+void mutate(Input* in, Input* other, uint64_t* rng) {
+
+    const uint8_t interesting[] = {0, 1, 0x7f, 0x80, 0xff, '0', '9', ' ', '\n'};
+    int rounds = 1 + next_random(rng) % MAX_HAVOC;
+
+    for (int r = 0; r < rounds; r++) {
+        uint64_t x = next_random(rng);
+        int pos = in->len > 0 ? (x >> 8) % in->len : 0;
+
+        switch (x % 7) {
+        case 0: // Flip a bit
+            if (in->len > 0) in->data[pos] ^= 1 << ((x >> 32) & 7);
+            break;
+        case 1: // Random byte
+            if (in->len > 0) in->data[pos] = x >> 32;
+            break;
+        case 2: // Interesting byte
+            if (in->len > 0) in->data[pos] = interesting[(x >> 32) % sizeof(interesting)];
+            break;
+        case 3: // Small add or subtract
+            if (in->len > 0) in->data[pos] += (int8_t)((x >> 32) % 17) - 8;
+            break;
+        case 4: // Insert random byte
+            if (in->len < fz.max_len) {
+                memmove(in->data + pos + 1, in->data + pos, in->len - pos);
+                in->data[pos] = x >> 32;
+                in->len++;
+            }
+            break;
+        case 5: // Delete a byte
+            if (in->len > 0) {
+                memmove(in->data + pos, in->data + pos + 1, in->len - pos - 1);
+                in->len--;
+            }
+            break;
+        case 6: // Splice tail of another input
+            if (other->len > 0) {
+                int from = (x >> 32) % other->len;
+                int len = other->len - from;
+                if (pos + len > fz.max_len) len = fz.max_len - pos;
+                memcpy(in->data + pos, other->data + from, len);
+                if (pos + len > in->len) in->len = pos + len;
+            }
+            break;
+        }
+    }
+}
+
+// Write input to <outdir>/<kind>_<n>
+void save_input(Input* in, const char* kind, int n) {
+
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s_%d", fz.outdir, kind, n);
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) return;
+    fwrite(in->data, 1, in->len, f);
+    fclose(f);
+}
+
+void* fuzz_worker(void* arg) {
+
+    uint64_t rng = 0x9e3779b97f4a7c15ULL * ((uintptr_t)arg + 1);
+
+    // Private emulator starting from a copy of the setup state
+    Emulator* e = malloc(sizeof(Emulator));
+    memcpy(e, fz.base, sizeof(Emulator));
+    e->dirty = calloc(1, sizeof(DirtyPages));
+    e->coverage = calloc(COVERAGE_SIZE, sizeof(uint8_t));
+    e->watch = new_watch();
+    for (int i = 0; i < fz.crash_count; i++) set_watch(e->watch, WATCH_EXEC, fz.crash_addrs[i], true);
+
+    // Local view of virgin bits, so most executions don't need the lock
+    uint8_t* virgin = malloc(COVERAGE_SIZE);
+    memset(virgin, 0xff, COVERAGE_SIZE);
+
+    Input in;
+    Input other;
+    uint64_t execs = 0;
+    while (!atomic_load_explicit(&fz.done, memory_order_relaxed)) {
+
+        pthread_mutex_lock(&fz.lock);
+        in = fz.corpus[next_random(&rng) % fz.corpus_count];
+        other = fz.corpus[next_random(&rng) % fz.corpus_count];
+        pthread_mutex_unlock(&fz.lock);
+
+        mutate(&in, &other, &rng);
+        reset_emulator(e);
+        write_input(e, &in);
+        run_emulator(e, fz.budget);
+
+        // Crash addresses stop the run, illegal opcodes halt on an empty microcode word
+        bool crash = e->stop || (e->halted && strcmp(get_mnemonic(e->i), "hlt") != 0);
+        bool hang = !crash && !e->halted;
+
+        if (new_coverage(virgin, e->coverage, false)) {
+            pthread_mutex_lock(&fz.lock);
+            if (new_coverage(fz.virgin, e->coverage, true)) add_corpus(&in);
+            memcpy(virgin, fz.virgin, COVERAGE_SIZE);
+            pthread_mutex_unlock(&fz.lock);
+        }
+
+        if (crash || hang) {
+            atomic_fetch_add(crash ? &fz.crashes : &fz.hangs, 1);
+            pthread_mutex_lock(&fz.lock);
+            int* saved = crash ? &fz.saved_crashes : &fz.saved_hangs;
+            if (*saved < MAX_SAVED) save_input(&in, crash ? "crash" : "hang", (*saved)++);
+            pthread_mutex_unlock(&fz.lock);
+        }
+
+        if (++execs % EXEC_BATCH == 0) atomic_fetch_add(&fz.execs, EXEC_BATCH);
+    }
+    atomic_fetch_add(&fz.execs, execs % EXEC_BATCH);
+
+    free(virgin);
+    free_watch(e->watch);
+    free(e->coverage);
+    free(e->dirty);
+    free(e);
+    return NULL;
+}
+
+// Read seed file into corpus
+bool load_seed(const char* file) {
+
+    FILE* f = fopen(file, "rb");
+    if (f == NULL) return false;
+
+    Input in;
+    in.len = fread(in.data, 1, fz.max_len, f);
+    fclose(f);
+    add_corpus(&in);
+    return true;
+}
+
+int main(int argc, const char** argv) {
+
+    const char* filename = "outputs/program.bin";
+    uint16_t entry = 0;
+    int seconds = DEFAULT_SECONDS;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    fz.max_len = MAX_INPUT_LEN;
+    fz.budget = DEFAULT_BUDGET;
+    fz.outdir = ".";
+    fz.corpus_capacity = DEFAULT_CORPUS_CAPACITY;
+    fz.corpus = calloc(fz.corpus_capacity, sizeof(Input));
+
+    Arch* arch = generate_architecture();
+    init_buckets();
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            entry = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            fz.input_addr = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            fz.max_len = strtoul(argv[++i], NULL, 0);
+            if (fz.max_len > MAX_INPUT_LEN) fz.max_len = MAX_INPUT_LEN;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            fz.budget = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            seconds = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            if (fz.crash_count == MAX_CRASH_ADDRS) {
+                printf("ERROR: At most %d crash addresses can be given\n", MAX_CRASH_ADDRS);
+                return 1;
+            }
+            fz.crash_addrs[fz.crash_count++] = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            fz.outdir = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            if (!load_seed(argv[++i])) printf("ERROR: Unable to read seed %s\n", argv[i]);
+        } else {
+            filename = argv[i];
+        }
+    }
+    if (fz.corpus_count == 0) add_corpus(&(Input){{0}, 0});
+    if (threads < 1) threads = 1;
+
+    // Run setup code once, up to the routine under test
+    Emulator* e = new_emulator(arch);
+    if (!load_program(e, filename)) {
+        printf("ERROR: Unable to read program %s\n", filename);
+        return 1;
+    }
+    while (!(e->step == 0 && e->pc == entry) && !e->halted && e->cycles < DEFAULT_SETUP_BUDGET) {
+        step_emulator(e);
+    }
+    if (e->step != 0 || e->pc != entry) {
+        printf("ERROR: Setup never reached entry %04x\n", entry);
+        return 1;
+    }
+    fz.base = e;
+
+    memset(fz.virgin, 0xff, COVERAGE_SIZE);
+    pthread_mutex_init(&fz.lock, NULL);
+    pthread_t* workers = calloc(threads, sizeof(pthread_t));
+    for (int i = 0; i < threads; i++) pthread_create(&workers[i], NULL, fuzz_worker, (void*)(uintptr_t)i);
+
+    for (int s = 1; s <= seconds; s++) {
+        sleep(1);
+        uint64_t execs = atomic_load(&fz.execs);
+        pthread_mutex_lock(&fz.lock);
+        printf("%3ds  execs: %" PRIu64 "  (%" PRIu64 "/s/core)  corpus: %d  edges: %d  crashes: %" PRIu64 "  hangs: %" PRIu64 "\n",
+               s, execs, execs / s / threads, fz.corpus_count, fz.edges,
+               atomic_load(&fz.crashes), atomic_load(&fz.hangs));
+        pthread_mutex_unlock(&fz.lock);
+    }
+
+    atomic_store(&fz.done, true);
+    for (int i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+
+    free(workers);
+    free(fz.corpus);
+    free(e);
+    return atomic_load(&fz.crashes) > 0 ? 1 : 0;
+}
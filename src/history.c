@@ -0,0 +1,51 @@
+#include <stdlib.h>
+
+#include "history.h"
+
+#define MIN_SNAPSHOTS (16)
+
+// Create history within budget bytes, a quarter of it for snapshots
+History* new_history(uint64_t budget, uint64_t interval) {
+
+    History* h = calloc(1, sizeof(History));
+
+    h->snapshot_size = budget / 4 / sizeof(Snapshot);
+    if (h->snapshot_size < MIN_SNAPSHOTS) h->snapshot_size = MIN_SNAPSHOTS;
+    h->journal_size = budget / 4 * 3 / sizeof(JournalEntry);
+    if (h->journal_size < 1) h->journal_size = 1;
+
+    h->snapshots = calloc(h->snapshot_size, sizeof(Snapshot));
+    h->journal = calloc(h->journal_size, sizeof(JournalEntry));
+    h->interval = interval;
+
+    return h;
+}
+
+void free_history(History* h) {
+
+    if (h == NULL) return;
+    free(h->snapshots);
+    free(h->journal);
+    free(h);
+}
+
+// Drop snapshots whose journal entries have been overwritten
+void drop_stale_snapshots(History* h) {
+
+    while (h->snapshot_tail < h->snapshot_head
+           && h->snapshots[h->snapshot_tail % h->snapshot_size].journal_pos < h->journal_tail) {
+        h->snapshot_tail++;
+    }
+}
+
+// Save old contents of memory about to be written
+void record_write(History* h, uint16_t addr, uint8_t old) {
+
+    if (h->journal_head - h->journal_tail == h->journal_size) {
+        h->journal_tail++;
+        drop_stale_snapshots(h);
+    }
+
+    h->journal[h->journal_head % h->journal_size] = (JournalEntry){addr, old};
+    h->journal_head++;
+}
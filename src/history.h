@@ -0,0 +1,49 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DEFAULT_HISTORY_BUDGET (64 << 20)   // Bytes
+#define DEFAULT_SNAPSHOT_INTERVAL (100000)  // Cycles
+
+// Old contents of a memory location, saved before it was written
+typedef struct {
+    uint16_t addr;
+    uint8_t old;
+} JournalEntry;
+
+// Register file at a point in time, and where the journal stood
+// Memory is never copied, it is rebuilt by undoing journal entries
+typedef struct {
+    uint8_t a, x, y, s, b, i;
+    uint16_t pc, sp, mr;
+    uint8_t step;
+    uint16_t upc;           // Micro-PC, when running compacted microcode
+    bool halted;
+    uint64_t cycles;
+    uint64_t fast_cycles;
+    uint64_t journal_pos;   // Journal entries before this belong to older snapshots
+} Snapshot;
+
+// Both journal and snapshots are rings, oldest entries are dropped to stay in budget
+typedef struct {
+    JournalEntry* journal;
+    uint64_t journal_size;      // Capacity in entries
+    uint64_t journal_head;      // Next entry to write
+    uint64_t journal_tail;      // Oldest entry still held
+
+    Snapshot* snapshots;
+    uint64_t snapshot_size;     // Capacity in snapshots
+    uint64_t snapshot_head;     // Next snapshot to write
+    uint64_t snapshot_tail;     // Oldest snapshot still held
+
+    uint64_t interval;          // Cycles between snapshots
+    uint64_t next_snapshot;     // Cycle next snapshot is due on
+} History;
+
+History* new_history(uint64_t budget, uint64_t interval);
+void free_history(History* h);
+void record_write(History* h, uint16_t addr, uint8_t old);
+
+#endif // HISTORY_H
@@ -0,0 +1,26 @@
+// Base architecture, the one the hardware is built for
+// 8 microcode steps per instruction, carry and zero flags, 15 branch instructions
+// Included once for the geometry, and again with ISA_TABLE defined for the instruction table
+#ifndef ISA_TABLE
+
+#define ISA_NAME "base"
+#define ISA_STEP_BITS (3)       // Steps per instruction are 1 << ISA_STEP_BITS
+
+// Status flags, in status register bit order, branch opcodes carry one bit for each
+// ALU_FLAG(name, value) is set from the ALU result on CTL_SET_STATUS, FLAG(name) is reserved
+#define ISA_FLAGS(ALU_FLAG, FLAG)           \
+    ALU_FLAG(CARRY, alu >> 8)               \
+    ALU_FLAG(ZERO, (alu & 0xff) == 0)       \
+    FLAG(TBD)
+
+#else
+
+#include "core.def"
+
+// Branch instructions
+ISA_BRANCH("bcs", FLAG_CARRY, FLAG_SET, "Branch if carry set")
+ISA_BRANCH("bcc", FLAG_CARRY, FLAG_CLR, "Branch if carry clear")
+ISA_BRANCH("bzs", FLAG_ZERO,  FLAG_SET, "Branch if zero set")
+ISA_BRANCH("bzc", FLAG_ZERO,  FLAG_CLR, "Branch if zero clear")
+
+#endif
@@ -1,9 +1,25 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "architecture.h"
+#include "rom.h"
+#include "compact.h"
 
-int main(void) {
+#define MAX_PATH_LEN (256)
+
+// Output directory defaults to outputs, variant builds pass their own
+// -c also reports on and writes the compacted microcode layout
+int main(int argc, const char** argv) {
+
+    const char* dir = "outputs";
+    bool compact = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0) compact = true;
+        else dir = argv[i];
+    }
+    char path[MAX_PATH_LEN];
 
     Arch* arch = generate_architecture();
 
@@ -14,25 +30,30 @@ int main(void) {
         printf("%02x: %s %s - %s\n", inst.opcode, inst.mnemonic, arg_strings[inst.arg_type], inst.desc);
     }
 
-    // Dump microcode out to a file
-    FILE *f = fopen("outputs/microcode.bin", "wb");
-    assert(f != NULL);
+    // One image per 8 bit chip, only changed pages need reprogramming
+    uint8_t chips[MICRO_CHIPS][MICRO_ROM_SIZE];
+    bool written;
+    split_microcode(arch->microcode, chips);
+    for (int i = 0; i < MICRO_CHIPS; i++) {
+        snprintf(path, sizeof(path), "%s/microcode_%d.bin", dir, i);
+        written = write_rom(path, chips[i], MICRO_ROM_SIZE);
+        assert(written);
+    }
 
-    for (int i = 0; i < MAX_OPCODES; i++) {
-        for (int j = 0; j < MAX_STEPS; j++) {
-            // Data is stored in 32bit int, but we only need 24 bits
-            uint32_t word = arch->microcode[i * MAX_STEPS + j];
-            uint8_t bytes[3];
-            bytes[2] = word & 0xff;
-            bytes[1] = (word >> 8) & 0xff;
-            bytes[0] = (word >> 16) & 0xff;
-            fwrite(bytes, sizeof(uint8_t), 3, f);
-        }
+    // Interleaved image of all chips, 3 bytes per control word, high byte first
+    uint8_t combined[MICRO_ROM_SIZE * MICRO_CHIPS];
+    for (int i = 0; i < MICRO_ROM_SIZE; i++) {
+        for (int j = 0; j < MICRO_CHIPS; j++) combined[i * MICRO_CHIPS + j] = chips[j][i];
     }
+    snprintf(path, sizeof(path), "%s/microcode.bin", dir);
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+    fwrite(combined, sizeof(uint8_t), sizeof(combined), f);
     fclose(f);
 
     // Dump opcodes out to file for assembler
-    f = fopen("outputs/instructions.txt", "w");
+    snprintf(path, sizeof(path), "%s/instructions.txt", dir);
+    f = fopen(path, "w");
     assert(f != NULL);
     char* arg_types[] = {"NONE", "BYTE", "ADDR", "PNTR"};
     for (int i = 0; i < arch->count; i++) {
@@ -41,4 +62,14 @@ int main(void) {
     }
     fclose(f);
 
+    // Compacted layout, with tails shared and an entry ROM in place of the step counter
+    if (compact) {
+        CompactRom* c = compact_microcode(arch->microcode);
+        printf("\n");
+        compact_report(c, arch, stdout);
+        printf("\n");
+        written = write_compact_rom(c, dir);
+        assert(written);
+        free(c);
+    }
 }
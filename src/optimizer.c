@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "architecture.h"
+#include "tokenizer.h"
+#include "optimizer.h"
+
+typedef enum {
+    ITEM_INS,           // Instruction and its argument
+    ITEM_LABEL,         // Label definition
+    ITEM_OTHER,         // Data, or anything the optimizer won't touch
+} ItemType;
+
+typedef struct {
+    ItemType type;
+    int start;          // Index of first token
+    int count;          // Number of tokens in item
+    uint8_t opcode;     // Opcode of instruction
+    ARG_TYPE arg_type;  // Argument type of instruction
+    int arg;            // Index of argument token, or -1
+} Item;
+
+typedef struct {
+    Token* tokens;
+    int count;
+    bool* removed;      // Tokens marked for removal
+
+    Item* items;
+    int item_count;
+
+    int cycles_saved;
+    int bytes_saved;
+} Optimizer;
+
+_Thread_local Optimizer o;
+
+// Size of an instruction in bytes
+int ins_size(ARG_TYPE type) {
+
+    switch (type) {
+    case ARG_NONE: return 1;
+    case ARG_BYTE: return 2;
+    default:       return 3;
+    }
+}
+
+// Whether two tokens refer to the same label or number
+bool same_arg(Token x, Token y) {
+
+    if (x.type != y.type) return false;
+    if (x.type == TOKEN_NUMBER) return x.val == y.val;
+    return x.len == y.len && strncmp(x.str, y.str, x.len) == 0;
+}
+
+// Whether an address argument might be a device register, labels are always code or data
+// A device register needn't read back what was written to it
+bool maybe_io(Token arg) {
+
+    return arg.type == TOKEN_NUMBER && arg.val >= DEVICE_BASE;
+}
+
+// Decode instruction starting at token i, mirroring the assembler's parse_mnemonic
+Item decode_ins(int i) {
+
+    Token t = o.tokens[i];
+    Token n = o.tokens[i + 1];
+    Item item = {ITEM_INS, i, 1, 0, ARG_NONE, -1};
+
+    if (n.type == TOKEN_STAR && ins_exists(t.str, ARG_PNTR)) {
+        item.arg_type = ARG_PNTR;
+        item.arg = i + 2;
+        item.count = 3;
+    } else if ((n.type == TOKEN_LABEL || n.type == TOKEN_NUMBER) && ins_exists(t.str, ARG_ADDR)) {
+        item.arg_type = ARG_ADDR;
+        item.arg = i + 1;
+        item.count = 2;
+    } else if (n.type == TOKEN_NUMBER && ins_exists(t.str, ARG_BYTE)) {
+        item.arg_type = ARG_BYTE;
+        item.arg = i + 1;
+        item.count = 2;
+    } else if (ins_exists(t.str, ARG_NONE)) {
+        item.arg_type = ARG_NONE;
+    } else {
+        // Malformed, leave it for the assembler to report
+        item.type = ITEM_OTHER;
+        return item;
+    }
+
+    item.opcode = get_opcode(t.str, item.arg_type);
+    return item;
+}
+
+// Split token stream into instructions, label definitions, and other tokens
+void decode_items(void) {
+
+    o.item_count = 0;
+    int i = 0;
+    while (i < o.count && o.tokens[i].type != TOKEN_END) {
+        Item item = {ITEM_OTHER, i, 1, 0, ARG_NONE, -1};
+        Token t = o.tokens[i];
+
+        if (t.type == TOKEN_MNEMONIC) {
+            item = decode_ins(i);
+        } else if (t.type == TOKEN_LABEL && o.tokens[i + 1].type == TOKEN_COLON) {
+            item.type = ITEM_LABEL;
+            item.count = 2;
+        }
+
+        o.items[o.item_count++] = item;
+        i += item.count;
+    }
+}
+
+// Whether label is defined by one of the label items directly following item i
+bool label_follows(int i, Token label) {
+
+    for (int j = i + 1; j < o.item_count && o.items[j].type == ITEM_LABEL; j++) {
+        if (same_arg(o.tokens[o.items[j].start], label)) return true;
+    }
+    return false;
+}
+
+// Mark all tokens of an item as removed, and account for savings
+void remove_item(Item item) {
+
+    for (int i = item.start; i < item.start + item.count; i++) o.removed[i] = true;
+    o.cycles_saved += get_cycles(item.opcode);
+    o.bytes_saved += ins_size(item.arg_type);
+}
+
+// Find branch taken for exactly the status bits the given branch is not
+bool inverse_branch(uint8_t opcode, uint8_t* inverse) {
+
+    uint16_t mask = ~get_branch_mask(opcode) & ((1 << (STATUS_MASK + 1)) - 1);
+    for (int op = BRANCH_BIT; op < MAX_OPCODES; op += STATUS_MASK + 1) {
+        if (get_inst(op) != NULL && get_branch_mask(op) == mask) {
+            *inverse = op;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Cycles a branch takes when it is, or is not, taken
+int branch_cycles(uint8_t opcode, bool taken) {
+
+    uint16_t mask = get_branch_mask(opcode);
+    for (uint8_t i = 0; i <= STATUS_MASK; i++) {
+        if (((mask >> i) & 1) == taken) return get_cycles(opcode + i);
+    }
+    return 0;
+}
+
+// Try each pattern on instruction at item i, return whether code was changed
+bool optimize_item(int i) {
+
+    Item x = o.items[i];
+    Token xt = o.tokens[x.start];
+
+    // jmp to the very next instruction
+    if (strncmp(xt.str, "jmp", 3) == 0 && o.tokens[x.arg].type == TOKEN_LABEL
+        && label_follows(i, o.tokens[x.arg])) {
+        remove_item(x);
+        return true;
+    }
+
+    if (i + 1 >= o.item_count || o.items[i + 1].type != ITEM_INS) return false;
+    Item y = o.items[i + 1];
+    Token yt = o.tokens[y.start];
+
+    // Load of a register just stored to the same address, unless a device may answer it
+    if (strncmp(xt.str, "st", 2) == 0 && strncmp(yt.str, "ld", 2) == 0 && xt.str[2] == yt.str[2]
+        && x.arg_type == ARG_ADDR && y.arg_type == ARG_PNTR
+        && same_arg(o.tokens[x.arg], o.tokens[y.arg]) && !maybe_io(o.tokens[x.arg])) {
+        remove_item(y);
+        return true;
+    }
+
+    // Transfer straight back to the source register
+    if (xt.str[0] == 't' && yt.str[0] == 't' && x.arg_type == ARG_NONE && y.arg_type == ARG_NONE
+        && xt.str[1] == yt.str[2] && xt.str[2] == yt.str[1]) {
+        remove_item(y);
+        return true;
+    }
+
+    // Branch over a jmp, replace with the inverse branch if neither outcome gets slower
+    uint8_t inv;
+    if (x.opcode >> 7 && strncmp(yt.str, "jmp", 3) == 0 && o.tokens[x.arg].type == TOKEN_LABEL
+        && label_follows(i + 1, o.tokens[x.arg]) && inverse_branch(x.opcode, &inv)) {
+        int old_skip = branch_cycles(x.opcode, true);
+        int old_jump = branch_cycles(x.opcode, false) + get_cycles(y.opcode);
+        int new_skip = branch_cycles(inv, false);
+        int new_jump = branch_cycles(inv, true);
+        if (new_skip > old_skip || new_jump > old_jump) return false;
+
+        o.tokens[x.start].str = get_inst(inv)->mnemonic;
+        o.tokens[x.arg] = o.tokens[y.arg];
+        for (int j = y.start; j < y.start + y.count; j++) o.removed[j] = true;
+        o.cycles_saved += (old_skip - new_skip) + (old_jump - new_jump);
+        o.bytes_saved += ins_size(y.arg_type);
+        return true;
+    }
+
+    return false;
+}
+
+// Drop removed tokens, return new token count
+int compact_tokens(void) {
+
+    int count = 0;
+    for (int i = 0; i < o.count; i++) {
+        if (!o.removed[i]) o.tokens[count++] = o.tokens[i];
+        o.removed[i] = false;
+    }
+    return count;
+}
+
+// Rewrite wasteful instruction sequences in place, return new token count
+// Runs before the assembler so label addresses are computed on the final code
+// Working arrays come from arena and are released with it
+int optimize(Token* tokens, int count, Arena* arena) {
+
+    o.tokens = tokens;
+    o.count = count;
+    o.removed = arena_alloc(arena, count * sizeof(bool));
+    o.items = arena_alloc(arena, count * sizeof(Item));
+    memset(o.removed, 0, count * sizeof(bool));
+    o.cycles_saved = 0;
+    o.bytes_saved = 0;
+
+    // Repeat until no pattern matches, as each rewrite can expose another
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        decode_items();
+        for (int i = 0; i < o.item_count; i++) {
+            if (o.items[i].type != ITEM_INS) continue;
+            if (optimize_item(i)) {
+                changed = true;
+                i++;    // Items following a rewrite are stale until next pass
+            }
+        }
+        o.count = compact_tokens();
+    }
+
+    printf("Optimizer saved %d cycles and %d bytes\n", o.cycles_saved, o.bytes_saved);
+
+    return o.count;
+}
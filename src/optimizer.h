@@ -0,0 +1,9 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "arena.h"
+#include "tokenizer.h"
+
+int optimize(Token* tokens, int count, Arena* arena);
+
+#endif // OPTIMIZER_H
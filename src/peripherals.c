@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "peripherals.h"
+
+typedef struct {
+    uint8_t ctrl;
+    uint16_t period;
+    uint8_t expired;        // Expiries since status was last read, saturating
+} Timer;
+
+uint8_t console_read(Device* d, uint16_t offset, uint64_t cycle) {
+
+    (void)d;
+    (void)cycle;
+    return offset == CONSOLE_STATUS;
+}
+
+void console_write(Device* d, uint16_t offset, uint8_t value, uint64_t cycle) {
+
+    (void)cycle;
+    if (offset == CONSOLE_DATA) fputc(value, d->state);
+}
+
+// Console printing to out, which is left open
+Device* new_console(uint16_t base, FILE* out) {
+
+    Device* d = calloc(1, sizeof(Device));
+    *d = (Device){"console", base, CONSOLE_SIZE, NULL, console_read, console_write, NULL, NULL, out};
+    return d;
+}
+
+// Queue the next expiry, one period from cycle
+void timer_schedule(Device* d, uint64_t cycle) {
+
+    Timer* t = d->state;
+    schedule_event(d->bus, d, cycle + (t->period == 0 ? 0x10000 : t->period), 0);
+}
+
+uint8_t timer_read(Device* d, uint16_t offset, uint64_t cycle) {
+
+    (void)cycle;
+    Timer* t = d->state;
+    switch (offset) {
+    case TIMER_CTRL:      return t->ctrl;
+    case TIMER_PERIOD_LO: return t->period & 0xff;
+    case TIMER_PERIOD_HI: return t->period >> 8;
+    case TIMER_STATUS: {
+        uint8_t expired = t->expired;
+        t->expired = 0;
+        return expired;
+    }
+    }
+    return 0;
+}
+
+void timer_write(Device* d, uint16_t offset, uint8_t value, uint64_t cycle) {
+
+    Timer* t = d->state;
+    switch (offset) {
+    case TIMER_CTRL:
+        t->ctrl = value;
+        cancel_events(d->bus, d);
+        if (value & TIMER_START) timer_schedule(d, cycle);
+        break;
+    case TIMER_PERIOD_LO: t->period = (t->period & 0xff00) | value; break;
+    case TIMER_PERIOD_HI: t->period = (t->period & 0x00ff) | (value << 8); break;
+    case TIMER_STATUS:    t->expired = 0; break;
+    }
+}
+
+void timer_event(Device* d, uint32_t tag, uint64_t cycle) {
+
+    (void)tag;
+    Timer* t = d->state;
+    if (t->expired < UINT8_MAX) t->expired++;
+    if (t->ctrl & TIMER_REPEAT) timer_schedule(d, cycle);
+    else t->ctrl &= ~TIMER_START;
+}
+
+void timer_free(Device* d) {
+    free(d->state);
+}
+
+// Programmable interval timer, polled through its status register
+Device* new_timer(uint16_t base) {
+
+    Device* d = calloc(1, sizeof(Device));
+    *d = (Device){"timer", base, TIMER_SIZE, NULL, timer_read, timer_write, timer_event, timer_free,
+                  calloc(1, sizeof(Timer))};
+    return d;
+}
@@ -0,0 +1,30 @@
+#ifndef PERIPHERALS_H
+#define PERIPHERALS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "device.h"
+
+#define CONSOLE_BASE (DEVICE_BASE)
+#define TIMER_BASE (DEVICE_BASE + 0x10)
+
+// Console registers
+#define CONSOLE_DATA (0)        // Write prints a character
+#define CONSOLE_STATUS (1)      // Reads 1, output is always ready
+#define CONSOLE_SIZE (2)
+
+// Timer registers
+#define TIMER_CTRL (0)          // Bit 0 starts, bit 1 repeats, writing restarts the count
+#define TIMER_PERIOD_LO (1)     // Cycles between expiries, 0 is 65536
+#define TIMER_PERIOD_HI (2)
+#define TIMER_STATUS (3)        // Expiries since last read, reading clears
+#define TIMER_SIZE (4)
+
+#define TIMER_START (1 << 0)
+#define TIMER_REPEAT (1 << 1)
+
+Device* new_console(uint16_t base, FILE* out);
+Device* new_timer(uint16_t base);
+
+#endif // PERIPHERALS_H
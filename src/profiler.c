@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "architecture.h"
+#include "profiler.h"
+
+#define TOP_PC_COUNT (20)
+
+Profile* new_profile(void) {
+
+    Profile* p = calloc(1, sizeof(Profile));
+
+    // Cache branch masks so fetch doesn't have to walk the microcode
+    for (int op = 1 << 7; op < MAX_OPCODES; op++) {
+        p->branch_mask[op] = get_branch_mask(op & ~STATUS_MASK);
+    }
+
+    return p;
+}
+
+// Close out the instruction that is executing, attributing its cycles
+void profile_flush(Profile* p, uint64_t cycle) {
+
+    if (!p->started) return;
+
+    p->opcode_cycles[p->opcode] += cycle - p->start;
+    p->pc_cycles[p->pc] += cycle - p->start;
+    p->start = cycle;
+}
+
+// Record fetch of a new instruction on the given cycle
+void profile_fetch(Profile* p, uint16_t pc, uint8_t opcode, uint8_t status, uint64_t cycle) {
+
+    profile_flush(p, cycle);
+
+    p->pc = pc;
+    p->opcode = opcode;
+    p->start = cycle;
+    p->started = true;
+    p->opcode_count[opcode]++;
+    p->pc_count[pc]++;
+
+    // Branch outcome is fixed by the status bits at fetch
+    if (opcode >> 7) {
+        if ((p->branch_mask[opcode] >> (status & STATUS_MASK)) & 1) {
+            p->branch_taken[opcode]++;
+        } else {
+            p->branch_skipped[opcode]++;
+        }
+    }
+}
+
+// Write cycles attributed to source lines and to the routines enclosing them
+void report_source(Profile* p, DebugMap* map, uint64_t total, FILE* f) {
+
+    uint64_t* line_cycles = calloc(map->entry_count, sizeof(uint64_t));
+    uint64_t* label_cycles = calloc(map->label_count + 1, sizeof(uint64_t));
+
+    for (int i = 0; i < MEM_SIZE; i++) {
+        if (p->pc_cycles[i] == 0) continue;
+        DebugEntry* entry = lookup_debug_entry(map, i);
+        if (entry == NULL) continue;
+        line_cycles[entry - map->entries] += p->pc_cycles[i];
+        uint32_t label = entry->label < map->label_count ? entry->label : map->label_count;
+        label_cycles[label] += p->pc_cycles[i];
+    }
+
+    fprintf(f, "\nRoutine                  Cycles       %%\n");
+    for (uint32_t i = 0; i <= map->label_count; i++) {
+        if (label_cycles[i] == 0) continue;
+        fprintf(f, "%-20s %12" PRIu64 "  %5.1f\n", debug_label_name(map, i),
+                label_cycles[i], 100.0 * label_cycles[i] / total);
+    }
+
+    fprintf(f, "\nLine    Address  Routine              Cycles       %%\n");
+    for (uint32_t i = 0; i < map->entry_count; i++) {
+        if (line_cycles[i] == 0) continue;
+        DebugEntry entry = map->entries[i];
+        fprintf(f, "%-7u %04x     %-16s %12" PRIu64 "  %5.1f\n", entry.line, entry.addr,
+                debug_label_name(map, entry.label), line_cycles[i], 100.0 * line_cycles[i] / total);
+    }
+
+    free(line_cycles);
+    free(label_cycles);
+}
+
+// Write flat report of where cycles were spent, by source line if map is given
+void profile_report(Profile* p, DebugMap* map, FILE* f) {
+
+    uint64_t total = 0;
+    for (int i = 0; i < MAX_OPCODES; i++) total += p->opcode_cycles[i];
+    if (total == 0) total = 1;
+
+    fprintf(f, "Opcode      Count        Cycles       %%\n");
+    for (int i = 0; i < MAX_OPCODES; i++) {
+        if (p->opcode_count[i] == 0) continue;
+        fprintf(f, "%02x %s  %12" PRIu64 " %12" PRIu64 "  %5.1f\n", i, get_mnemonic(i),
+                p->opcode_count[i], p->opcode_cycles[i], 100.0 * p->opcode_cycles[i] / total);
+    }
+
+    fprintf(f, "\nBranch      Taken        Not Taken\n");
+    for (int i = 1 << 7; i < MAX_OPCODES; i++) {
+        if (p->branch_taken[i] + p->branch_skipped[i] == 0) continue;
+        fprintf(f, "%02x %s  %12" PRIu64 " %12" PRIu64 "\n", i, get_mnemonic(i),
+                p->branch_taken[i], p->branch_skipped[i]);
+    }
+
+    // Selection of the hottest addresses, leaving the rest of the table alone
+    fprintf(f, "\nAddress     Count        Cycles       %%\n");
+    bool shown[MEM_SIZE] = {0};
+    for (int n = 0; n < TOP_PC_COUNT; n++) {
+        int best = -1;
+        for (int i = 0; i < MEM_SIZE; i++) {
+            if (!shown[i] && p->pc_cycles[i] > 0 && (best < 0 || p->pc_cycles[i] > p->pc_cycles[best]))
+                best = i;
+        }
+        if (best < 0) break;
+        shown[best] = true;
+        fprintf(f, "%04x        %12" PRIu64 " %12" PRIu64 "  %5.1f\n", best,
+                p->pc_count[best], p->pc_cycles[best], 100.0 * p->pc_cycles[best] / total);
+    }
+
+    if (map != NULL) report_source(p, map, total, f);
+
+    fprintf(f, "\nMicrocode   Step  Cycles\n");
+    for (int i = 0; i < MAX_OPCODES * MAX_STEPS; i++) {
+        if (p->micro_cycles[i] == 0) continue;
+        fprintf(f, "%03x %s     %d  %12" PRIu64 "\n", i, get_mnemonic(i / MAX_STEPS),
+                i % MAX_STEPS, p->micro_cycles[i]);
+    }
+}
+
+// Write collapsed stacks for flame graph tools
+// Stacks are routine and source line if map is given, otherwise opcode and microcode step
+void profile_folded(Profile* p, DebugMap* map, FILE* f) {
+
+    if (map != NULL) {
+        for (int i = 0; i < MEM_SIZE; i++) {
+            if (p->pc_cycles[i] == 0) continue;
+            DebugEntry* entry = lookup_debug_entry(map, i);
+            if (entry == NULL) {
+                fprintf(f, "??;%04x %" PRIu64 "\n", i, p->pc_cycles[i]);
+            } else {
+                fprintf(f, "%s;line_%u %" PRIu64 "\n", debug_label_name(map, entry->label),
+                        entry->line, p->pc_cycles[i]);
+            }
+        }
+        return;
+    }
+
+    for (int i = 0; i < MAX_OPCODES * MAX_STEPS; i++) {
+        if (p->micro_cycles[i] == 0) continue;
+        uint8_t opcode = i / MAX_STEPS;
+        fprintf(f, "%s_%02x;step_%d %" PRIu64 "\n", get_mnemonic(opcode), opcode,
+                i % MAX_STEPS, p->micro_cycles[i]);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "architecture.h"
+#include "debugmap.h"
+
+typedef struct {
+    // Counters
+    uint64_t micro_cycles[MAX_OPCODES * MAX_STEPS]; // Cycles by microcode address
+    uint64_t opcode_cycles[MAX_OPCODES];            // Cycles by opcode
+    uint64_t opcode_count[MAX_OPCODES];             // Instructions executed by opcode
+    uint64_t pc_cycles[MEM_SIZE];                   // Cycles by instruction address
+    uint64_t pc_count[MEM_SIZE];                    // Instructions executed by address
+    uint64_t branch_taken[MAX_OPCODES];             // Taken branches by opcode
+    uint64_t branch_skipped[MAX_OPCODES];           // Branches not taken by opcode
+
+    // Instruction currently executing
+    uint16_t pc;            // Address instruction was fetched from
+    uint8_t opcode;         // Opcode of instruction
+    uint64_t start;         // Cycle instruction was fetched on
+    bool started;           // Whether an instruction has been fetched yet
+
+    uint16_t branch_mask[MAX_OPCODES];  // Status bits each branch is taken for
+} Profile;
+
+Profile* new_profile(void);
+void profile_fetch(Profile* p, uint16_t pc, uint8_t opcode, uint8_t status, uint64_t cycle);
+void profile_flush(Profile* p, uint64_t cycle);
+void profile_report(Profile* p, DebugMap* map, FILE* f);
+void profile_folded(Profile* p, DebugMap* map, FILE* f);
+
+#endif // PROFILER_H
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rom.h"
+
+#define MAX_PATH_LEN (256)
+
+// Bitwise CRC-32 (IEEE), images are small enough not to need a table
+uint32_t crc32(const uint8_t* data, uint32_t len) {
+
+    uint32_t crc = 0xffffffff;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+// Split 24 bit control words into one image per chip, chip 0 holds the high byte
+void split_microcode(const uint32_t* microcode, uint8_t chips[MICRO_CHIPS][MICRO_ROM_SIZE]) {
+
+    for (int i = 0; i < MICRO_ROM_SIZE; i++) {
+        for (int c = 0; c < MICRO_CHIPS; c++) {
+            chips[c][i] = microcode[i] >> (8 * (MICRO_CHIPS - 1 - c));
+        }
+    }
+}
+
+// Read all of the previous build of an image, whatever its size, into a new buffer
+// Return the buffer and set size, or return NULL if there was none
+uint8_t* read_previous(const char* file, uint32_t* size) {
+
+    FILE* f = fopen(file, "rb");
+    if (f == NULL) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (len <= 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    uint8_t* buffer = malloc(len);
+    *size = fread(buffer, 1, len, f);
+    fclose(f);
+    return buffer;
+}
+
+// Write image to file, and a patch of the pages that differ from the previous build to <file>.patch
+// Each file is built in memory and written with a single fwrite
+bool write_rom(const char* file, const uint8_t* image, uint32_t size) {
+
+    // Patch applies to the whole previous image, even if it was longer
+    uint32_t old_size = 0;
+    uint8_t* old = read_previous(file, &old_size);
+    uint32_t base_crc = old != NULL ? crc32(old, old_size) : 0;
+
+    // Patch can be at most every page of the image
+    uint32_t pages = (size + EEPROM_PAGE_SIZE - 1) / EEPROM_PAGE_SIZE;
+    uint8_t* patch = malloc(sizeof(PatchHeader) + pages * (sizeof(PatchPage) + EEPROM_PAGE_SIZE));
+    uint8_t* p = patch + sizeof(PatchHeader);
+
+    uint32_t changed = 0;
+    for (uint32_t addr = 0; addr < size; addr += EEPROM_PAGE_SIZE) {
+        uint32_t len = size - addr < EEPROM_PAGE_SIZE ? size - addr : EEPROM_PAGE_SIZE;
+        if (addr + len <= old_size && memcmp(old + addr, image + addr, len) == 0) continue;
+
+        PatchPage page = {addr, crc32(image + addr, len)};
+        memcpy(p, &page, sizeof(page));
+        memcpy(p + sizeof(page), image + addr, len);
+        p += sizeof(page) + len;
+        changed++;
+    }
+
+    PatchHeader h = {PATCH_MAGIC, size, EEPROM_PAGE_SIZE, changed, base_crc, crc32(image, size)};
+    memcpy(patch, &h, sizeof(h));
+    free(old);
+
+    // Image
+    FILE* f = fopen(file, "wb");
+    if (f == NULL) {
+        free(patch);
+        return false;
+    }
+    fwrite(image, 1, size, f);
+    fclose(f);
+
+    // Patch
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s.patch", file);
+    f = fopen(path, "wb");
+    if (f == NULL) {
+        free(patch);
+        return false;
+    }
+    fwrite(patch, 1, p - patch, f);
+    fclose(f);
+    free(patch);
+
+    printf("%s: %u of %u pages changed, crc %08x\n", file, changed, pages, h.crc);
+    return true;
+}
@@ -0,0 +1,33 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "architecture.h"
+
+#define EEPROM_PAGE_SIZE (64)                       // Bytes the programmer writes at once
+#define MICRO_CHIPS (MICRO_DATA_WIDTH / 8)          // 8 bit chips holding each control word
+#define MICRO_ROM_SIZE (1 << MICRO_ADDR_WIDTH)      // Bytes in each microcode chip
+#define PATCH_MAGIC "RPAT"
+
+// Patch file header, followed by a PatchPage and its bytes for each changed page
+typedef struct {
+    char magic[4];
+    uint32_t image_size;
+    uint32_t page_size;
+    uint32_t page_count;    // Pages in the patch
+    uint32_t base_crc;      // CRC-32 of the image the patch applies to, 0 if there was none
+    uint32_t crc;           // CRC-32 of the image after patching
+} PatchHeader;
+
+typedef struct {
+    uint32_t addr;          // Page aligned address
+    uint32_t crc;           // CRC-32 of the page's new bytes
+} PatchPage;
+
+uint32_t crc32(const uint8_t* data, uint32_t len);
+void split_microcode(const uint32_t* microcode, uint8_t chips[MICRO_CHIPS][MICRO_ROM_SIZE]);
+bool write_rom(const char* file, const uint8_t* image, uint32_t size);
+
+#endif // ROM_H
@@ -0,0 +1,402 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+
+#include "architecture.h"
+#include "assembler.h"
+#include "emulator.h"
+#include "peripherals.h"
+
+#define MAX_EXPECTS (64)
+#define MAX_WATCHES (16)
+#define MAX_PRECISE_RANGES (16)
+#define MAX_LINE_LEN (256)
+#define MAX_PATH_LEN (256)
+#define MAX_MESSAGE_LEN (128)
+#define DEFAULT_TEST_CAPACITY (256)
+#define DEFAULT_BUDGET (10000000ULL)    // Cycles per test unless the test sets its own
+
+// One expected value of a register or memory location after the program halts
+typedef struct {
+    bool mem;           // Whether index is a memory address, otherwise a REG_TYPE
+    uint16_t index;
+    uint16_t val;
+} Expect;
+
+typedef struct {
+    char file[MAX_PATH_LEN];
+    Expect expects[MAX_EXPECTS];
+    int expect_count;
+    uint64_t budget;
+    uint64_t cycles_expected;       // Cycles run until halt or stop, 0 if not checked
+    bool devices;                   // Whether console and timer are attached
+    uint16_t precise[MAX_PRECISE_RANGES][2];
+    int precise_count;
+    uint16_t watches[MAX_WATCHES];  // Address of each breakpoint or write watchpoint
+    WATCH_TYPE watch_types[MAX_WATCHES];
+    int watch_count;
+
+    // Results
+    bool passed;
+    char message[MAX_MESSAGE_LEN];  // Why the test failed
+    uint64_t cycles;
+    double wall_ms;
+} Test;
+
+typedef struct {
+    Test* tests;
+    int count;
+    int capacity;
+    _Atomic int next;           // Next test for a worker to pick up
+
+    Emulator* reset;            // Emulator after decoding microcode, copied before each test
+    uint64_t budget;
+    bool stepping;              // Step every microcode step in every test
+    bool devices;               // Attach devices to every test, not only those asking for them
+    FILE* console;              // Where console output of every test goes
+} Runner;
+
+Runner r;
+
+const char* reg_names[REG_COUNT] = {"a", "x", "y", "s", "pc", "sp", "mr"};
+
+void add_test(const char* file) {
+
+    if (r.count == r.capacity) {
+        r.capacity *= 2;
+        r.tests = realloc(r.tests, r.capacity * sizeof(Test));
+    }
+    Test* t = &r.tests[r.count++];
+    memset(t, 0, sizeof(Test));
+    snprintf(t->file, sizeof(t->file), "%s", file);
+}
+
+int compare_tests(const void* x, const void* y) {
+    return strcmp(((const Test*)x)->file, ((const Test*)y)->file);
+}
+
+// Add every .asm file in directory, in name order
+bool add_directory(const char* path) {
+
+    DIR* dir = opendir(path);
+    if (dir == NULL) return false;
+
+    int first = r.count;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len < 4 || strcmp(entry->d_name + len - 4, ".asm") != 0) continue;
+
+        char file[2 * MAX_PATH_LEN];
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        add_test(file);
+    }
+    closedir(dir);
+
+    qsort(r.tests + first, r.count - first, sizeof(Test), compare_tests);
+    return true;
+}
+
+// Parse one "name=value" expectation, return whether valid
+bool parse_expect(Test* t, const char* str) {
+
+    if (t->expect_count == MAX_EXPECTS) return false;
+    Expect* x = &t->expects[t->expect_count];
+
+    const char* eq = strchr(str, '=');
+    if (eq == NULL) return false;
+    x->val = strtoul(eq + 1, NULL, 0);
+
+    if (str[0] == '[') {
+        x->mem = true;
+        x->index = strtoul(str + 1, NULL, 0);
+        t->expect_count++;
+        return true;
+    }
+    for (int i = 0; i < REG_COUNT; i++) {
+        if (strlen(reg_names[i]) == (size_t)(eq - str) && strncmp(str, reg_names[i], eq - str) == 0) {
+            x->mem = false;
+            x->index = i;
+            t->expect_count++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Add breakpoint or write watchpoint on address, return whether there was room
+bool add_watch(Test* t, WATCH_TYPE type, const char* str) {
+
+    if (t->watch_count == MAX_WATCHES) return false;
+    t->watches[t->watch_count] = strtoul(str, NULL, 0);
+    t->watch_types[t->watch_count++] = type;
+    return true;
+}
+
+// Add range of addresses that are always stepped, start:end or a single address
+bool add_precise(Test* t, const char* str) {
+
+    if (t->precise_count == MAX_PRECISE_RANGES) return false;
+    char* end;
+    uint32_t first = strtoul(str, &end, 0);
+    uint32_t last = *end == ':' ? strtoul(end + 1, NULL, 0) : first;
+    if (first > last || last >= MEM_SIZE) return false;
+
+    t->precise[t->precise_count][0] = first;
+    t->precise[t->precise_count][1] = last;
+    t->precise_count++;
+    return true;
+}
+
+// Read "; expect", "; budget" and setup comments from test source
+// e.g. "; expect a=5 [0x1000]=0x2a" and "; budget 5000"
+// "; cycles 1234" checks cycles run, "; devices" attaches console and timer, "; precise 0x10:0x20"
+// always steps those addresses, and "; break 0x10" or "; watch 0x1000" stop the run there instead
+// of at the halt, expectations are then checked where it stopped
+bool read_expectations(Test* t) {
+
+    FILE* f = fopen(t->file, "r");
+    if (f == NULL) return false;
+
+    t->budget = r.budget;
+    char line[MAX_LINE_LEN];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char* c = line;
+        while (*c == ' ' || *c == '\t') c++;
+
+        bool ok = true;
+        if (strncmp(c, "; budget", 8) == 0) {
+            t->budget = strtoull(c + 8, NULL, 0);
+        } else if (strncmp(c, "; cycles", 8) == 0) {
+            t->cycles_expected = strtoull(c + 8, NULL, 0);
+        } else if (strncmp(c, "; devices", 9) == 0) {
+            t->devices = true;
+        } else if (strncmp(c, "; precise", 9) == 0) {
+            ok = add_precise(t, c + 9);
+        } else if (strncmp(c, "; break", 7) == 0) {
+            ok = add_watch(t, WATCH_EXEC, c + 7);
+        } else if (strncmp(c, "; watch", 7) == 0) {
+            ok = add_watch(t, WATCH_WRITE, c + 7);
+        } else if (strncmp(c, "; expect", 8) == 0) {
+            char* save;
+            for (char* tok = strtok_r(c + 8, " \t\n", &save); tok != NULL; tok = strtok_r(NULL, " \t\n", &save)) {
+                if (!parse_expect(t, tok)) {
+                    snprintf(t->message, sizeof(t->message), "invalid expectation '%s'", tok);
+                    fclose(f);
+                    return false;
+                }
+            }
+        }
+        if (!ok) {
+            snprintf(t->message, sizeof(t->message), "invalid setup '%.*s'", (int)strcspn(c, "\n"), c);
+            fclose(f);
+            return false;
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+
+// Compare final state with expectations, describing the first mismatch
+bool check_expectations(Test* t, Emulator* e) {
+
+    uint16_t regs[REG_COUNT] = {e->a, e->x, e->y, e->s, e->pc, e->sp, e->mr};
+    for (int i = 0; i < t->expect_count; i++) {
+        Expect x = t->expects[i];
+        uint16_t val = x.mem ? e->mem[x.index] : regs[x.index];
+        if (val == x.val) continue;
+
+        if (x.mem) snprintf(t->message, sizeof(t->message), "[%04x] is %02x, expected %02x", x.index, val, x.val);
+        else snprintf(t->message, sizeof(t->message), "%s is %02x, expected %02x", reg_names[x.index], val, x.val);
+        return false;
+    }
+
+    if (t->cycles_expected != 0 && e->cycles != t->cycles_expected) {
+        snprintf(t->message, sizeof(t->message), "took %" PRIu64 " cycles, expected %" PRIu64,
+                 e->cycles, t->cycles_expected);
+        return false;
+    }
+    return true;
+}
+
+double elapsed_ms(struct timespec start) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) * 1e3 + (now.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+// Assemble and run test on emulator e, recording the result in the test
+void run_test(Test* t, Emulator* e) {
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!read_expectations(t)) {
+        if (t->message[0] == 0) snprintf(t->message, sizeof(t->message), "unable to read source");
+        t->wall_ms = elapsed_ms(start);
+        return;
+    }
+
+    // Assembler state is thread local, each worker assembles independently
+    int len = assemble_file(t->file, false, false);
+    if (len < 0 || a.errors > 0) {
+        snprintf(t->message, sizeof(t->message), "assembly failed");
+        t->wall_ms = elapsed_ms(start);
+        return;
+    }
+
+    memcpy(e, r.reset, sizeof(Emulator));
+    memcpy(e->mem, a.code, len);
+
+    e->stepping = r.stepping;
+    for (int i = 0; i < t->precise_count; i++) set_precise(e, t->precise[i][0], t->precise[i][1], true);
+
+    if (r.devices || t->devices) {
+        e->bus = new_bus();
+        if (!attach_device(e->bus, new_console(CONSOLE_BASE, r.console))
+            || !attach_device(e->bus, new_timer(TIMER_BASE))) {
+            snprintf(t->message, sizeof(t->message), "unable to map devices");
+            free_bus(e->bus);
+            t->wall_ms = elapsed_ms(start);
+            return;
+        }
+    }
+
+    if (t->watch_count > 0) {
+        e->watch = new_watch();
+        for (int i = 0; i < t->watch_count; i++) set_watch(e->watch, t->watch_types[i], t->watches[i], true);
+    }
+
+    run_emulator(e, t->budget);
+    t->cycles = e->cycles;
+
+    if (!e->halted && !e->stop) snprintf(t->message, sizeof(t->message), "no halt within %" PRIu64 " cycles", t->budget);
+    else t->passed = check_expectations(t, e);
+
+    free_bus(e->bus);
+    free_watch(e->watch);
+
+    t->wall_ms = elapsed_ms(start);
+}
+
+void* test_worker(void* arg) {
+
+    (void)arg;
+    Emulator* e = malloc(sizeof(Emulator));
+
+    int i;
+    while ((i = atomic_fetch_add(&r.next, 1)) < r.count) run_test(&r.tests[i], e);
+
+    free_assembler();
+    free(e);
+    return NULL;
+}
+
+// Write string as a JSON string literal
+void write_json_string(FILE* f, const char* str) {
+
+    fputc('"', f);
+    for (const char* c = str; *c != 0; c++) {
+        if (*c == '"' || *c == '\\') fputc('\\', f);
+        fputc(*c, f);
+    }
+    fputc('"', f);
+}
+
+bool write_results(const char* file, int passed, double wall_ms) {
+
+    FILE* f = fopen(file, "w");
+    if (f == NULL) return false;
+
+    fprintf(f, "{\n  \"passed\": %d,\n  \"failed\": %d,\n  \"wall_ms\": %.3f,\n  \"tests\": [\n",
+            passed, r.count - passed, wall_ms);
+    for (int i = 0; i < r.count; i++) {
+        Test* t = &r.tests[i];
+        fprintf(f, "    {\"file\": ");
+        write_json_string(f, t->file);
+        fprintf(f, ", \"passed\": %s, \"cycles\": %" PRIu64 ", \"wall_ms\": %.3f, \"message\": ",
+                t->passed ? "true" : "false", t->cycles, t->wall_ms);
+        write_json_string(f, t->message);
+        fprintf(f, "}%s\n", i + 1 < r.count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    fclose(f);
+    return true;
+}
+
+int main(int argc, const char** argv) {
+
+    const char* results_name = NULL;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    r.budget = DEFAULT_BUDGET;
+    r.capacity = DEFAULT_TEST_CAPACITY;
+    r.tests = calloc(r.capacity, sizeof(Test));
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            r.budget = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            results_name = argv[++i];
+        } else if (strcmp(argv[i], "-S") == 0) {
+            r.stepping = true;
+        } else if (strcmp(argv[i], "-D") == 0) {
+            r.devices = true;
+        } else if (!add_directory(argv[i])) {
+            add_test(argv[i]);
+        }
+    }
+    if (r.count == 0) {
+        printf("Usage: runner [-j threads] [-c cycles] [-o results.json] [-S] [-D] <test.asm | directory>...\n");
+        free(r.tests);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > r.count) threads = r.count;
+
+    // Architecture tables are generated once and only read from here on
+    Arch* arch = generate_architecture();
+    r.reset = new_emulator(arch);
+
+    // Console output isn't checked, it is only discarded
+    r.console = fopen("/dev/null", "w");
+    if (r.console == NULL) r.console = stdout;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t* workers = calloc(threads, sizeof(pthread_t));
+    for (int i = 0; i < threads; i++) pthread_create(&workers[i], NULL, test_worker, NULL);
+    for (int i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+
+    double wall_ms = elapsed_ms(start);
+
+    int passed = 0;
+    for (int i = 0; i < r.count; i++) {
+        Test* t = &r.tests[i];
+        if (t->passed) passed++;
+        else printf("FAIL %s: %s\n", t->file, t->message);
+    }
+    printf("Passed %d of %d tests in %.1f ms on %d threads\n", passed, r.count, wall_ms, threads);
+
+    if (results_name != NULL && !write_results(results_name, passed, wall_ms)) {
+        printf("ERROR: Unable to open %s\n", results_name);
+    }
+
+    free(workers);
+    if (r.console != stdout) fclose(r.console);
+    free(r.reset);
+    free(r.tests);
+    return passed == r.count ? 0 : 1;
+}
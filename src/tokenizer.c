@@ -21,24 +21,40 @@
 #define PRINT_ERR(str) (printf("ERROR Line %ld: " str "\n", tz.line))
 
 #define DEFAULT_TOKEN_CAPACITY (1 << 8)
+#define MAX_EXPANSION_DEPTH (16)
+#define MAX_EXPANDED_TOKENS (1 << 20)   // More than enough for 64K of code
 
-Tokenizer tz;
+const char* directive_names[DIRECTIVE_COUNT] = {".macro", ".endm", ".rept", ".endr"};
 
-void read_source(const char* file) {
+// Thread local, so test runners can tokenize on several threads at once
+_Thread_local Tokenizer tz;
+
+bool read_source(const char* file) {
     
     // First read entire file into a buffer
     FILE* f;
     f = fopen(file, "r");
+    if (f == NULL) {
+        printf("ERROR: Unable to open %s\n", file);
+        return false;
+    }
 
     fseek(f, 0, SEEK_END);
     tz.len = ftell(f);
     rewind(f);
 
-    tz.src = calloc(1, tz.len + 1);   // File ends with NUL char
-    fread(tz.src, 1, tz.len, f);
+    tz.src = arena_alloc(tz.arena, tz.len + 1);
+    tz.len = fread(tz.src, 1, tz.len, f);
+    tz.src[tz.len] = 0;               // File ends with NUL char
+    fclose(f);
+    tz.line = 1;                      // Lines are numbered from 1, as in editors
 
     tz.capacity = DEFAULT_TOKEN_CAPACITY;
-    tz.tokens = calloc(tz.capacity, sizeof(Token));
+    tz.tokens = arena_alloc(tz.arena, tz.capacity * sizeof(Token));
+    tz.count = 0;
+    tz.directives = 0;
+    tz.macro_defs = 0;
+    return true;
 }
 
 void print_token(Token t) {
@@ -62,25 +78,35 @@ void print_token(Token t) {
     case TOKEN_STAR:
         printf("[STAR]\n");
         break;
+    case TOKEN_DIRECTIVE:
+        printf("[DIRECTIVE] - %s\n", directive_names[t.val]);
+        break;
     case TOKEN_END:
         printf("[END]\n");
         break;
     }
 }
 
+// Grow token array to hold count more tokens
+// Tokens are the newest allocation while tokenizing, so this grows in place
+void reserve_tokens(int count) {
+
+    int capacity = tz.capacity;
+    while (tz.count + count > capacity) capacity *= 2;
+    if (capacity == tz.capacity) return;
+
+    tz.tokens = arena_grow(tz.arena, tz.tokens, tz.capacity * sizeof(Token), capacity * sizeof(Token));
+    tz.capacity = capacity;
+}
+
 void store_token(Token t) {
 
     // Grow token array if necessary
-    if (tz.count == tz.capacity) {
-        tz.capacity *= 2;
-        tz.tokens = realloc(tz.tokens, tz.capacity * sizeof(Token));
-    }
+    if (tz.count == tz.capacity) reserve_tokens(1);
 
     // Add token to array
     tz.tokens[tz.count] = t;
     tz.count++;
-
-    print_token(t);
 }
 
 // Parse up to a 32bit hex value
@@ -133,10 +159,159 @@ bool match(char val) {
     return true;
 }
 
-int tokenize(const char* file, Token** tokens) {
+// Index of the directive closing the block whose body starts at start, or -1 if there is none
+// Blocks of the same kind nest, e.g. .rept inside .rept
+int find_block_end(Token* raw, int start, DirectiveType open, DirectiveType close) {
+
+    int depth = 0;
+    for (int i = start; raw[i].type != TOKEN_END; i++) {
+        if (raw[i].type != TOKEN_DIRECTIVE) continue;
+        if (raw[i].val == open) depth++;
+        else if (raw[i].val == close && depth-- == 0) return i;
+    }
+    return -1;
+}
+
+// Return macro named by token, or NULL if there is none
+Macro* find_macro(Token t) {
+
+    for (int i = 0; i < tz.macro_count; i++) {
+        Macro* m = &tz.macros[i];
+        if (m->name.len == t.len && strncmp(m->name.str, t.str, t.len) == 0) return m;
+    }
+    return NULL;
+}
+
+// Whether a label stored next starts a statement, rather than being an instruction's argument
+bool starts_statement(void) {
+
+    if (tz.count == 0) return true;
+    Token prev = tz.tokens[tz.count - 1];
+    return prev.type != TOKEN_STAR && !(prev.type == TOKEN_MNEMONIC && ins_exists(prev.str, ARG_ADDR));
+}
+
+// Append count expanded tokens from start, times over, attributed to origin line
+bool replay_tokens(int start, int count, uint32_t times, uint32_t origin) {
+
+    if (tz.count + (uint64_t)count * times > MAX_EXPANDED_TOKENS) {
+        PRINT_ERR("Expansion too large");
+        return false;
+    }
+    reserve_tokens(count * times);
+
+    for (uint32_t i = 0; i < times; i++) {
+        memcpy(&tz.tokens[tz.count], &tz.tokens[start], count * sizeof(Token));
+        for (int j = 0; j < count; j++) tz.tokens[tz.count + j].origin = origin;
+        tz.count += count;
+    }
+    return true;
+}
+
+// Expand scanned tokens from start up to end, defining macros and replaying .rept blocks and macro calls
+// Each body is expanded once, later repeats and calls copy the tokens that produced
+// origin is the line of the outermost .rept or macro call being expanded, or 0
+bool expand_tokens(Token* raw, int start, int end, uint32_t origin, int depth) {
+
+    for (int i = start; i < end; i++) {
+        Token t = raw[i];
+        tz.line = t.line;   // For error reporting
+        uint32_t outer = origin != 0 ? origin : t.line;
+
+        // Macro definition
+        if (t.type == TOKEN_DIRECTIVE && t.val == DIRECTIVE_MACRO) {
+            int close = find_block_end(raw, i + 1, DIRECTIVE_MACRO, DIRECTIVE_ENDM);
+            if (depth > 0) {
+                PRINT_ERR(".macro inside .rept or macro");
+                return false;
+            }
+            if (raw[i + 1].type != TOKEN_LABEL || find_macro(raw[i + 1]) != NULL) {
+                PRINT_ERR("Expected new macro name after .macro");
+                return false;
+            }
+            if (close < 0) {
+                PRINT_ERR(".macro without .endm");
+                return false;
+            }
+            tz.macros[tz.macro_count++] = (Macro){raw[i + 1], i + 2, close, -1, 0};
+            i = close;
+
+        // Repeated block, expanded once and copied for the remaining repeats
+        } else if (t.type == TOKEN_DIRECTIVE && t.val == DIRECTIVE_REPT) {
+            int close = find_block_end(raw, i + 1, DIRECTIVE_REPT, DIRECTIVE_ENDR);
+            if (raw[i + 1].type != TOKEN_NUMBER) {
+                PRINT_ERR("Expected repeat count after .rept");
+                return false;
+            }
+            if (close < 0) {
+                PRINT_ERR(".rept without .endr");
+                return false;
+            }
+            if (depth == MAX_EXPANSION_DEPTH) {
+                PRINT_ERR(".rept nested too deep");
+                return false;
+            }
+
+            uint32_t times = raw[i + 1].val;
+            if (times > 0) {
+                int first = tz.count;
+                if (!expand_tokens(raw, i + 2, close, outer, depth + 1)) return false;
+                tz.line = t.line;
+                if (!replay_tokens(first, tz.count - first, times - 1, outer)) return false;
+            }
+            i = close;
+
+        } else if (t.type == TOKEN_DIRECTIVE) {
+            PRINT_ERR("Unmatched .endm or .endr");
+            return false;
+
+        // Macro call, a label on its own that names a macro
+        } else if (t.type == TOKEN_LABEL && raw[i + 1].type != TOKEN_COLON && starts_statement()
+                   && find_macro(t) != NULL) {
+            Macro* m = find_macro(t);
+            if (depth == MAX_EXPANSION_DEPTH) {
+                PRINT_ERR("Macro calls nested too deep");
+                return false;
+            }
+
+            if (m->cache_start < 0) {
+                int first = tz.count;
+                if (!expand_tokens(raw, m->start, m->end, outer, depth + 1)) return false;
+                m->cache_start = first;
+                m->cache_count = tz.count - first;
+            } else if (!replay_tokens(m->cache_start, m->cache_count, 1, outer)) {
+                return false;
+            }
+
+        } else {
+            t.origin = origin;
+            store_token(t);
+        }
+    }
+    return true;
+}
+
+// Expand directives in the scanned tokens into a new token array
+bool expand_source(void) {
+
+    Token* raw = tz.tokens;
+    int count = tz.count;
+
+    tz.macros = arena_alloc(tz.arena, tz.macro_defs * sizeof(Macro));
+    tz.macro_count = 0;
+    tz.capacity = count;
+    tz.tokens = arena_alloc(tz.arena, tz.capacity * sizeof(Token));
+    tz.count = 0;
+
+    return expand_tokens(raw, 0, count, 0, 0);
+}
+
+// Tokenize file, allocating source and tokens from arena
+int tokenize(const char* file, Token** tokens, Arena* arena, bool verbose) {
 
     // Read source and initialize file
-    read_source(file);
+    tz.arena = arena;
+    tz.verbose = verbose;
+    if (!read_source(file)) return 0;
 
     char* c = tz.src;
     while (*c != 0) {
@@ -147,6 +322,7 @@ int tokenize(const char* file, Token** tokens) {
         Token t;
         t.str = c;          // Start of token string
         t.line = tz.line;   // Current line
+        t.origin = 0;
 
         // Mnemonic or Label
         if (IS_LETTER(*c)) {
@@ -165,6 +341,29 @@ int tokenize(const char* file, Token** tokens) {
             store_token(t);
             continue;
 
+        // Directive
+        } else if (*c == '.') {
+
+            // Seek to end of name
+            c++;
+            while (IS_ALPHAN(*c)) c++;
+            t.len = c - t.str;
+
+            t.type = TOKEN_DIRECTIVE;
+            t.val = DIRECTIVE_COUNT;
+            for (int i = 0; i < DIRECTIVE_COUNT; i++) {
+                if (strlen(directive_names[i]) == t.len && strncmp(t.str, directive_names[i], t.len) == 0) t.val = i;
+            }
+            if (t.val == DIRECTIVE_COUNT) {
+                PRINT_ERR("Unknown directive");
+                return 0;
+            }
+
+            tz.directives++;
+            if (t.val == DIRECTIVE_MACRO) tz.macro_defs++;
+            store_token(t);
+            continue;
+
         // Hex Number
         } else if (strncmp(c, "0x", 2) == 0){
 
@@ -255,6 +454,18 @@ int tokenize(const char* file, Token** tokens) {
         store_token(t);
     }
 
+    // Source ending right after a token never reaches the end of file case
+    if (tz.count == 0 || tz.tokens[tz.count - 1].type != TOKEN_END) {
+        store_token((Token){TOKEN_END, 0, c, 1, tz.line, 0});
+    }
+
+    // Replay .rept blocks and macro calls from the tokens scanned above, never the source text
+    if (tz.directives > 0 && !expand_source()) return 0;
+
+    if (tz.verbose) {
+        for (int i = 0; i < tz.count; i++) print_token(tz.tokens[i]);
+    }
+
     *tokens = tz.tokens;
     return tz.count;
 }
@@ -1,6 +1,11 @@
 #ifndef TOKENIZER_H
 #define TOKENIZER_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "arena.h"
+
 typedef enum {
     TOKEN_END,
     TOKEN_MNEMONIC,
@@ -9,17 +14,36 @@ typedef enum {
     TOKEN_STRING,
     TOKEN_STAR,
     TOKEN_COLON,
+    TOKEN_DIRECTIVE,
 } TokenType;
 
+typedef enum {
+    DIRECTIVE_MACRO,    // .macro <name>, starts a macro body
+    DIRECTIVE_ENDM,     // .endm, ends a macro body
+    DIRECTIVE_REPT,     // .rept <count>, starts a block repeated count times
+    DIRECTIVE_ENDR,     // .endr, ends a repeated block
+    DIRECTIVE_COUNT,
+} DirectiveType;
+
 typedef struct {
     TokenType type;
-    uint32_t val;       // Value of number token
+    uint32_t val;       // Value of number token, or DirectiveType
     char* str;          // Pointer to string in source code
     uint32_t len;       // Length of string
 
     uint32_t line;      // Line in source code
+    uint32_t origin;    // Line of the outermost .rept or macro call it was expanded by, or 0
 } Token;
 
+// Macro body, a slice of the tokens as scanned
+typedef struct {
+    Token name;
+    int start;          // First token of body
+    int end;            // Token ending body, its .endm
+    int cache_start;    // First expanded token of its first call, replayed by later calls, or -1
+    int cache_count;    // Expanded tokens of its first call
+} Macro;
+
 typedef struct {
     char* src;      // Source code
     long len;       // Length of source code
@@ -30,9 +54,17 @@ typedef struct {
     Token* tokens;  // Array of Tokens
     int capacity;   // Token Array Capacity
     int count;      // Count of Tokens in Array
+
+    int directives; // Directives scanned, expanded once scanning is done
+    int macro_defs; // Macros defined by the directives
+    Macro* macros;  // Macros defined so far while expanding
+    int macro_count;
+
+    Arena* arena;   // Source and tokens live here until it is reset
+    bool verbose;   // Print tokens once tokenized
 } Tokenizer;
 
-int tokenize(const char* file, Token** tokens);
+int tokenize(const char* file, Token** tokens, Arena* arena, bool verbose);
 
 #endif // TOKENIZER_H
 
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "architecture.h"
+#include "trace.h"
+
+// Each encoded record is a header byte of these bits, followed by the fields they flag
+#define TRACE_PC        (1 << 0)    // PC moved, zigzag varint delta follows
+#define TRACE_OPCODE    (1 << 1)    // Opcode changed, byte follows
+#define TRACE_STEP      (1 << 2)    // Step isn't previous + 1 or 0, byte follows
+#define TRACE_STEP_ZERO (1 << 3)    // Step reset to 0
+#define TRACE_ABUS      (1 << 4)    // Address bus isn't PC, zigzag varint delta from PC follows
+#define TRACE_DBUS      (1 << 5)    // Data bus changed, byte follows
+#define TRACE_STATUS    (1 << 6)    // Status changed, byte follows
+
+#define MAX_RECORD_BYTES (11)
+#define WRITER_SLEEP_NS (50000)
+
+// Write 16 bit delta as zigzag varint, return bytes written
+int put_delta(uint8_t* buf, uint16_t delta) {
+
+    uint16_t zz = (uint16_t)(delta << 1) ^ (uint16_t)(-(delta >> 15));
+    int len = 0;
+    while (zz >= 0x80) {
+        buf[len++] = (zz & 0x7f) | 0x80;
+        zz >>= 7;
+    }
+    buf[len++] = zz;
+    return len;
+}
+
+// Read zigzag varint into 16 bit delta, return bytes read
+int get_delta(const uint8_t* buf, uint16_t* delta) {
+
+    uint16_t zz = 0;
+    int len = 0;
+    int shift = 0;
+    do {
+        zz |= (buf[len] & 0x7f) << shift;
+        shift += 7;
+    } while (buf[len++] & 0x80 && len < 3);
+
+    *delta = (zz >> 1) ^ (uint16_t)(-(zz & 1));
+    return len;
+}
+
+// Encode record against the previous one, return bytes written
+int encode_record(uint8_t* buf, TraceRecord* prev, TraceRecord r) {
+
+    uint8_t header = 0;
+    int len = 1;
+
+    if (r.pc != prev->pc) {
+        header |= TRACE_PC;
+        len += put_delta(buf + len, r.pc - prev->pc);
+    }
+    if (r.opcode != prev->opcode) {
+        header |= TRACE_OPCODE;
+        buf[len++] = r.opcode;
+    }
+    if (r.step == 0) {
+        header |= TRACE_STEP_ZERO;
+    } else if (r.step != (uint8_t)(prev->step + 1)) {
+        header |= TRACE_STEP;
+        buf[len++] = r.step;
+    }
+    if (r.abus != r.pc) {
+        header |= TRACE_ABUS;
+        len += put_delta(buf + len, r.abus - r.pc);
+    }
+    if (r.dbus != prev->dbus) {
+        header |= TRACE_DBUS;
+        buf[len++] = r.dbus;
+    }
+    if (r.status != prev->status) {
+        header |= TRACE_STATUS;
+        buf[len++] = r.status;
+    }
+
+    buf[0] = header;
+    *prev = r;
+    return len;
+}
+
+// Background thread, drains ring and streams encoded records to disk
+void* trace_writer(void* arg) {
+
+    Trace* t = arg;
+    uint8_t* buf = malloc(TRACE_BUFFER_SIZE);
+    int len = 0;
+    TraceRecord prev = {0};
+    prev.step = 0xff;   // So a first step of 0 is predicted
+
+    uint64_t tail = 0;
+    while (true) {
+        // Read stop before head, so records published before stop are never missed
+        bool stop = atomic_load_explicit(&t->stop, memory_order_acquire);
+        uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+
+        if (tail == head) {
+            if (stop) break;
+            nanosleep(&(struct timespec){0, WRITER_SLEEP_NS}, NULL);
+            continue;
+        }
+
+        for (; tail < head; tail++) {
+            if (len > TRACE_BUFFER_SIZE - MAX_RECORD_BYTES) {
+                fwrite(buf, 1, len, t->f);
+                t->bytes += len;
+                len = 0;
+                atomic_store_explicit(&t->tail, tail, memory_order_release);
+            }
+            len += encode_record(buf + len, &prev, t->ring[tail & (TRACE_RING_SIZE - 1)]);
+        }
+        atomic_store_explicit(&t->tail, tail, memory_order_release);
+    }
+
+    fwrite(buf, 1, len, t->f);
+    t->bytes += len;
+    t->records = tail;
+    free(buf);
+    return NULL;
+}
+
+// Open trace file and start background writer, return NULL on failure
+Trace* start_trace(const char* file) {
+
+    FILE* f = fopen(file, "wb");
+    if (f == NULL) return NULL;
+
+    uint32_t magic = TRACE_MAGIC;
+    fwrite(&magic, sizeof(magic), 1, f);
+
+    Trace* t = calloc(1, sizeof(Trace));
+    t->ring = malloc(TRACE_RING_SIZE * sizeof(TraceRecord));
+    t->f = f;
+    pthread_create(&t->writer, NULL, trace_writer, t);
+
+    return t;
+}
+
+// Flush remaining records, and close trace
+void stop_trace(Trace* t) {
+
+    atomic_store_explicit(&t->head, t->next, memory_order_release);
+    atomic_store_explicit(&t->stop, true, memory_order_release);
+    pthread_join(t->writer, NULL);
+    fclose(t->f);
+
+    printf("Trace: %" PRIu64 " steps in %" PRIu64 " bytes\n", t->records, t->bytes);
+
+    free(t->ring);
+    free(t);
+}
+
+// Decode trace file to text, with source locations if map is given
+bool dump_trace(const char* file, DebugMap* map, FILE* out) {
+
+    FILE* f = fopen(file, "rb");
+    if (f == NULL) return false;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+
+    uint8_t* buf = malloc(size + MAX_RECORD_BYTES);
+    fread(buf, 1, size, f);
+    memset(buf + size, 0, MAX_RECORD_BYTES);
+    fclose(f);
+
+    uint32_t magic;
+    memcpy(&magic, buf, sizeof(magic));
+    if (size < (long)sizeof(magic) || magic != TRACE_MAGIC) {
+        free(buf);
+        return false;
+    }
+
+    TraceRecord r = {0};
+    r.step = 0xff;
+    uint64_t cycle = 0;
+    long i = sizeof(magic);
+    while (i < size) {
+        uint8_t header = buf[i++];
+        uint16_t delta;
+
+        if (header & TRACE_PC) {
+            i += get_delta(buf + i, &delta);
+            r.pc += delta;
+        }
+        if (header & TRACE_OPCODE) r.opcode = buf[i++];
+        if (header & TRACE_STEP_ZERO) {
+            r.step = 0;
+        } else if (header & TRACE_STEP) {
+            r.step = buf[i++];
+        } else {
+            r.step++;
+        }
+        r.abus = r.pc;
+        if (header & TRACE_ABUS) {
+            i += get_delta(buf + i, &delta);
+            r.abus += delta;
+        }
+        if (header & TRACE_DBUS) r.dbus = buf[i++];
+        if (header & TRACE_STATUS) r.status = buf[i++];
+
+        fprintf(out, "%10" PRIu64 "  PC: %04x  I: %02x %s  Step: %d  Addr: %04x  Data: %02x  S: %02x",
+                cycle, r.pc, r.opcode, get_mnemonic(r.opcode), r.step, r.abus, r.dbus, r.status);
+        if (map != NULL) {
+            DebugEntry* entry = lookup_debug_entry(map, r.pc);
+            if (entry != NULL) fprintf(out, "  %s:%u", debug_label_name(map, entry->label), entry->line);
+        }
+        fprintf(out, "\n");
+        cycle++;
+    }
+
+    free(buf);
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "debugmap.h"
+
+#define TRACE_MAGIC (0x45435254)        // "TRCE"
+#define TRACE_RING_SIZE (1 << 20)       // Records, must be a power of 2
+#define TRACE_BUFFER_SIZE (1 << 16)     // Bytes of encoded output buffered per write
+#define TRACE_PUBLISH_SIZE (1 << 8)     // Records emulator writes before publishing them
+
+// State of the processor for one microcode step
+typedef struct {
+    uint16_t pc;        // Program counter at start of step
+    uint16_t abus;      // Address bus
+    uint8_t opcode;     // Instruction register
+    uint8_t step;       // Microcode step
+    uint8_t dbus;       // Data bus
+    uint8_t status;     // Status register
+} TraceRecord;
+
+// Single producer, single consumer ring between emulator and writer thread
+// Emulator and writer fields sit on separate cache lines, and the emulator publishes
+// records in batches, so the two threads rarely touch the same line
+typedef struct {
+    TraceRecord* ring;
+
+    _Alignas(64) uint64_t next;     // Next record emulator will write
+    uint64_t tail_cache;            // Emulator's last view of tail, refreshed only when ring looks full
+
+    _Alignas(64) _Atomic uint64_t head; // Records published to writer
+    _Atomic bool stop;                  // Set when emulator is done producing
+
+    _Alignas(64) _Atomic uint64_t tail; // Next record writer will encode
+
+    FILE* f;
+    pthread_t writer;
+    uint64_t records;       // Records written, for reporting
+    uint64_t bytes;         // Encoded bytes written, for reporting
+} Trace;
+
+Trace* start_trace(const char* file);
+void stop_trace(Trace* t);
+bool dump_trace(const char* file, DebugMap* map, FILE* out);
+
+// Wait for space, then add a record to the ring
+static inline void trace_record(Trace* t, TraceRecord r) {
+
+    uint64_t next = t->next;
+    while (next - t->tail_cache >= TRACE_RING_SIZE) {
+        t->tail_cache = atomic_load_explicit(&t->tail, memory_order_acquire);
+        if (next - t->tail_cache >= TRACE_RING_SIZE) sched_yield();
+    }
+
+    t->ring[next & (TRACE_RING_SIZE - 1)] = r;
+    t->next = ++next;
+    if ((next & (TRACE_PUBLISH_SIZE - 1)) == 0) {
+        atomic_store_explicit(&t->head, next, memory_order_release);
+    }
+}
+
+#endif // TRACE_H
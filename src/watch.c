@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "watch.h"
+
+#define IS_WSPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n')
+
+// Compiler state for a breakpoint condition
+typedef struct {
+    const char* curs;           // Current position in expression
+    uint8_t code[MAX_COND_LEN]; // Compiled bytecode
+    int len;                    // Length of bytecode
+    bool ok;                    // Whether expression is valid so far
+} CondCompiler;
+
+CondCompiler cc;
+
+Watch* new_watch(void) {
+    return calloc(1, sizeof(Watch));
+}
+
+void free_watch(Watch* w) {
+
+    if (w == NULL) return;
+    for (int i = 0; i < MEM_SIZE; i++) free(w->conds[i]);
+    free(w);
+}
+
+// Set or clear watch of type on address
+void set_watch(Watch* w, WATCH_TYPE type, uint16_t addr, bool on) {
+
+    if (on) {
+        w->maps[type][addr >> 6] |= 1ULL << (addr & 63);
+    } else {
+        w->maps[type][addr >> 6] &= ~(1ULL << (addr & 63));
+    }
+
+    // Conditions only live as long as their breakpoint, as does stepping over it
+    if (type == WATCH_EXEC && !on) {
+        free(w->conds[addr]);
+        w->conds[addr] = NULL;
+        if (w->hit_addr == addr) w->resume = false;
+    }
+}
+
+void cond_emit(uint8_t byte) {
+
+    if (cc.len == MAX_COND_LEN - 1) {
+        printf("ERROR: Condition too long\n");
+        cc.ok = false;
+        return;
+    }
+    cc.code[cc.len++] = byte;
+}
+
+// Consume str if expression continues with it
+bool cond_accept(const char* str) {
+
+    while (IS_WSPACE(*cc.curs)) cc.curs++;
+    if (strncmp(cc.curs, str, strlen(str)) != 0) return false;
+    cc.curs += strlen(str);
+    return true;
+}
+
+void compile_or(void);
+
+void compile_operand(void) {
+
+    const char* regs[REG_COUNT] = {"a", "x", "y", "s", "pc", "sp", "mr"};
+
+    while (IS_WSPACE(*cc.curs)) cc.curs++;
+
+    if (cond_accept("[")) {
+        compile_or();
+        cond_emit(COND_MEM);
+        if (!cond_accept("]")) cc.ok = false;
+        return;
+    }
+    if (cond_accept("(")) {
+        compile_or();
+        if (!cond_accept(")")) cc.ok = false;
+        return;
+    }
+
+    if (*cc.curs >= '0' && *cc.curs <= '9') {
+        char* end;
+        unsigned long val = strtoul(cc.curs, &end, 0);
+        cc.curs = end;
+        cond_emit(COND_IMM);
+        cond_emit(val >> 8);
+        cond_emit(val);
+        return;
+    }
+
+    // Match longest register names first, so "pc" isn't read as something shorter
+    for (int i = REG_COUNT - 1; i >= 0; i--) {
+        int len = strlen(regs[i]);
+        char next = cc.curs[len];
+        bool alnum = (next >= 'a' && next <= 'z') || (next >= '0' && next <= '9');
+        if (strncmp(cc.curs, regs[i], len) == 0 && !alnum) {
+            cc.curs += len;
+            cond_emit(COND_REG);
+            cond_emit(i);
+            return;
+        }
+    }
+
+    cc.ok = false;
+}
+
+void compile_cmp(void) {
+
+    compile_operand();
+
+    // Two character operators before their one character prefixes
+    const char* ops[] = {"==", "!=", "<=", ">=", "<", ">"};
+    const uint8_t codes[] = {COND_EQ, COND_NE, COND_LE, COND_GE, COND_LT, COND_GT};
+    for (int i = 0; i < 6; i++) {
+        if (cond_accept(ops[i])) {
+            compile_operand();
+            cond_emit(codes[i]);
+            return;
+        }
+    }
+}
+
+void compile_and(void) {
+
+    compile_cmp();
+    while (cond_accept("&&")) {
+        compile_cmp();
+        cond_emit(COND_AND);
+    }
+}
+
+void compile_or(void) {
+
+    compile_and();
+    while (cond_accept("||")) {
+        compile_and();
+        cond_emit(COND_OR);
+    }
+}
+
+// Compile expression to a condition on exec breakpoint at addr, return whether valid
+bool set_condition(Watch* w, uint16_t addr, const char* expr) {
+
+    cc.curs = expr;
+    cc.len = 0;
+    cc.ok = true;
+
+    compile_or();
+    cond_emit(COND_END);
+    while (IS_WSPACE(*cc.curs)) cc.curs++;
+    if (*cc.curs != 0) cc.ok = false;
+
+    if (!cc.ok) {
+        printf("ERROR: Invalid condition '%s'\n", expr);
+        return false;
+    }
+
+    free(w->conds[addr]);
+    w->conds[addr] = malloc(cc.len);
+    memcpy(w->conds[addr], cc.code, cc.len);
+    return true;
+}
+
+// Run condition bytecode against registers and memory
+bool eval_condition(const uint8_t* code, const uint16_t* regs, const uint8_t* mem) {
+
+    uint16_t stack[MAX_COND_LEN];
+    int top = 0;
+
+    for (int i = 0; code[i] != COND_END; i++) {
+        uint16_t x = 0;
+        uint16_t y = 0;
+        if (code[i] >= COND_EQ) {
+            y = stack[--top];
+            x = stack[--top];
+        }
+
+        switch (code[i]) {
+        case COND_REG: stack[top++] = regs[code[++i]]; break;
+        case COND_IMM: stack[top++] = (code[i + 1] << 8) | code[i + 2]; i += 2; break;
+        case COND_MEM: stack[top - 1] = mem[stack[top - 1]]; break;
+        case COND_EQ:  stack[top++] = x == y; break;
+        case COND_NE:  stack[top++] = x != y; break;
+        case COND_LT:  stack[top++] = x < y; break;
+        case COND_GT:  stack[top++] = x > y; break;
+        case COND_LE:  stack[top++] = x <= y; break;
+        case COND_GE:  stack[top++] = x >= y; break;
+        case COND_AND: stack[top++] = x && y; break;
+        case COND_OR:  stack[top++] = x || y; break;
+        }
+    }
+
+    return top > 0 && stack[top - 1] != 0;
+}
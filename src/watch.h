@@ -0,0 +1,67 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "architecture.h"
+
+#define MAX_COND_LEN (64)
+
+typedef enum {
+    WATCH_NONE,
+    WATCH_EXEC,     // Instruction fetched from address
+    WATCH_READ,     // Data read from address
+    WATCH_WRITE,    // Data written to address
+    WATCH_TYPES,
+} WATCH_TYPE;
+
+// Registers visible to breakpoint conditions
+typedef enum {
+    REG_A,
+    REG_X,
+    REG_Y,
+    REG_S,
+    REG_PC,
+    REG_SP,
+    REG_MR,
+    REG_COUNT,
+} REG_TYPE;
+
+// Stack machine instructions for breakpoint conditions
+typedef enum {
+    COND_END,
+    COND_REG,       // Push register, next byte is REG_TYPE
+    COND_IMM,       // Push 16 bit value, next two bytes, high byte first
+    COND_MEM,       // Pop address, push byte of memory at it
+    COND_EQ,
+    COND_NE,
+    COND_LT,
+    COND_GT,
+    COND_LE,
+    COND_GE,
+    COND_AND,
+    COND_OR,
+} COND_OP;
+
+typedef struct {
+    uint64_t maps[WATCH_TYPES][MEM_SIZE / 64]; // One bit per address for each watch type
+    uint8_t* conds[MEM_SIZE];                  // Condition for exec breakpoint, or NULL if none
+
+    WATCH_TYPE hit;         // Type of watch that stopped the emulator, or WATCH_NONE
+    uint16_t hit_addr;      // Address that was hit
+    bool resume;            // Skip the exec breakpoint on the next fetch
+} Watch;
+
+Watch* new_watch(void);
+void free_watch(Watch* w);
+void set_watch(Watch* w, WATCH_TYPE type, uint16_t addr, bool on);
+bool set_condition(Watch* w, uint16_t addr, const char* expr);
+bool eval_condition(const uint8_t* code, const uint16_t* regs, const uint8_t* mem);
+
+// Whether address is watched for type, a single bit test
+static inline bool test_watch(Watch* w, WATCH_TYPE type, uint16_t addr) {
+    return (w->maps[type][addr >> 6] >> (addr & 63)) & 1;
+}
+
+#endif // WATCH_H
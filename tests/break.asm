@@ -0,0 +1,19 @@
+; stop at a breakpoint after a loop run as whole instructions, before done's first instruction
+; break 0x11
+; expect a=0 x=0 y=5 pc=0x11
+; cycles 160
+    ldy 0
+    ldx 5
+loop:
+    tya
+    ccf
+    add 1
+    tay
+    txa
+    scf
+    sub 1
+    tax
+    bzc loop
+done:
+    lda 0xee
+    hlt
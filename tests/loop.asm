@@ -0,0 +1,17 @@
+; add 3 to a memory counter 4 times, counting down in x
+; expect a=0 x=0 [0x1000]=0x0c
+; cycles 152
+    lda 0
+    sta 0x1000
+    ldx 4
+loop:
+    lda *0x1000
+    ccf
+    add 3
+    sta 0x1000
+    txa
+    scf
+    sub 1
+    tax
+    bzc loop
+    hlt
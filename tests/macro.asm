@@ -0,0 +1,31 @@
+; nested .rept around macros saving and restoring registers on the stack
+; expect a=0x30 x=3 y=4 sp=0xfff0 [0x2000]=0x30
+; cycles 453
+.macro save
+    psa
+    psx
+    psy
+.endm
+.macro restore
+    ppy
+    ppx
+    ppa
+.endm
+.macro bump
+    ccf
+    add 1
+.endm
+    lsp 0xfff0
+    lda 0
+    ldx 3
+    ldy 4
+.rept 4
+    .rept 12
+        bump
+    .endr
+    save
+    lda 0x77
+    restore
+.endr
+    sta 0x2000
+    hlt
@@ -0,0 +1,23 @@
+; step part of the block at step and one instruction of the loop, the rest runs whole instructions
+; precise 0x16:0x1b
+; precise 0x0e
+; expect a=0 x=0 [0x1000]=0x0c
+; cycles 147
+    lda 0
+    sta 0x1000
+    ldx 3
+loop:
+    jmp step
+back:
+    txa
+    scf
+    sub 1
+    tax
+    bzc loop
+    hlt
+step:
+    lda *0x1000
+    ccf
+    add 4
+    sta 0x1000
+    jmp back
@@ -0,0 +1,28 @@
+; poll the timer for three expiries of a 100 cycle period, counting polls at 0x1000
+; devices
+; expect x=0 [0x1000]=8
+; cycles 367
+    lda 0
+    sta 0x1000
+    lda 100
+    sta 0xff11
+    lda 0
+    sta 0xff12
+    lda 3
+    sta 0xff10
+    ldx 3
+wait:
+    lda *0x1000
+    ccf
+    add 1
+    sta 0x1000
+    lda *0xff13
+    scf
+    cmp 0
+    bzs wait
+    txa
+    scf
+    sub 1
+    tax
+    bzc wait
+    hlt
@@ -0,0 +1,15 @@
+; stop at a write watchpoint on the first store to 0x1001, after a loop of stores to 0x1000
+; watch 0x1001
+; expect a=5 [0x1000]=5 [0x1001]=5 [0x1002]=0
+; cycles 131
+    lda 0
+loop:
+    ccf
+    add 1
+    sta 0x1000
+    scf
+    cmp 5
+    bzc loop
+    sta 0x1001
+    sta 0x1002
+    hlt